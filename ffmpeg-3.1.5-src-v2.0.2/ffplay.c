@@ -64,6 +64,8 @@
 #include "libavutil/samplefmt.h"
 #include "libavutil/avassert.h"
 #include "libavutil/time.h"
+#include "libavutil/atomic.h"
+#include "libavutil/cpu.h"
 #include "libavformat/avformat.h"
 #include "libavdevice/avdevice.h"
 #include "libswscale/swscale.h"
@@ -84,11 +86,33 @@
 
 #include <assert.h>
 
+/* daipozhi modified, subtitle blending uses SSE2 where the compiler has it on
+   and AVX2 when the CPU has it, the functions get the target themselves */
+#if ARCH_X86 && defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_BLEND_SSE2 1
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#include <immintrin.h>
+#define HAVE_BLEND_AVX2 1
+#endif
+#endif
+
 const char program_name[] = "ffplay";
 const int program_birth_year = 2003;
 
 #define MAX_QUEUE_SIZE (15 * 1024 * 1024)
 #define MIN_FRAMES 25
+
+/* daipozhi modified, buffering is counted in seconds per stream. The high
+ * watermark starts at BUFFER_MIN_SECONDS, doubles when the queue runs dry
+ * after it was full and shrinks back when it has not for BUFFER_DECAY_TIME.
+ * read_thread is woken when a queue falls to BUFFER_LOW_RATIO of it.
+ * MIN_FRAMES is only used for streams without packet durations. */
+#define BUFFER_MIN_SECONDS 1.0
+#define BUFFER_MAX_SECONDS 30.0
+#define BUFFER_LOW_RATIO 0.5
+#define BUFFER_DECAY_TIME 60000000
+#define BUFFER_MAX_SIZE (64 * 1024 * 1024)     /* MAX_QUEUE_SIZE once a target has grown */
 #define EXTERNAL_CLOCK_MIN_FRAMES 2
 #define EXTERNAL_CLOCK_MAX_FRAMES 10
 
@@ -146,6 +170,14 @@ typedef struct PacketQueue {
     int serial;
     SDL_mutex *mutex;
     SDL_cond *cond;
+    int waiting;                /* daipozhi modified, the reader sleeps on cond */
+    MyAVPacketList *free_pkt;   /* daipozhi modified, nodes kept for reuse instead of av_free() */
+    int64_t alloc_avoided;      /* number of av_malloc() calls saved by free_pkt */
+    struct VideoState *is;      /* daipozhi modified, read_thread to wake at the low watermark */
+    double time_base;           /* of the stream, for the duration watermark */
+    double target;              /* high watermark in seconds */
+    int filled;                 /* reached target since the last flush */
+    int64_t last_underrun;      /* av_gettime_relative() of the last growth or decay */
 } PacketQueue;
 
 #define VIDEO_PICTURE_QUEUE_SIZE 3
@@ -177,16 +209,22 @@ typedef struct Frame {
     AVFrame *frame;
     AVSubtitle sub;
     AVSubtitleRect **subrects;  /* rescaled subtitle rectangles in yuva */
+    uint8_t **subalpha;   /* daipozhi modified, per rect the alpha of the chroma planes, made with subrects */
+    int sub_id;           /* daipozhi modified, subtitle: counts subtitles; picture: the one blended in, 0 none */
     int serial;
     double pts;           /* presentation timestamp for the frame */
     double duration;      /* estimated duration of the frame */
     int64_t pos;          /* byte position of the frame in the input file */
     SDL_Overlay *bmp;
-    int allocated;
+    int upload;           /* daipozhi modified, frame is kept in ->frame until the main thread gives it an overlay */
     int reallocate;
     int width;
     int height;
     AVRational sar;
+    int track;            /* daipozhi modified for gapless, file the frame is of, see VideoState.gap_trk */
+    int dr;               /* daipozhi modified, bmp planes point into frame instead of its own buffer */
+    Uint8 *dr_pixels[3];  /* the overlay's own planes, put back when the frame is released */
+    Uint16 dr_pitches[3];
 } Frame;
 
 typedef struct FrameQueue {
@@ -200,6 +238,9 @@ typedef struct FrameQueue {
     SDL_mutex *mutex;
     SDL_cond *cond;
     PacketQueue *pktq;
+    int waiting;     /* daipozhi modified, one side sleeps on cond; size and waiting are atomic,
+                        the writer owns windex, the reader rindex, so the mutex is only
+                        taken when a side has to sleep */
 } FrameQueue;
 
 enum {
@@ -208,6 +249,14 @@ enum {
     AV_SYNC_EXTERNAL_CLOCK, /* synchronize to an external clock */
 };
 
+// daipozhi modified for gapless, a file played in the same streams, track 0 the first one
+typedef struct GapTrack {
+    AVFormatContext *ic;
+    int stream;                     // its audio stream
+    int slot;                       // its row slot, -1 if not known yet
+    unsigned stamp;
+} GapTrack;
+
 typedef struct Decoder {
     AVPacket pkt;
     AVPacket pkt_temp;
@@ -216,14 +265,52 @@ typedef struct Decoder {
     int pkt_serial;
     int finished;
     int packet_pending;
-    SDL_cond *empty_queue_cond;
     int64_t start_pts;
     AVRational start_pts_tb;
     int64_t next_pts;
     AVRational next_pts_tb;
     SDL_Thread *decoder_tid;
+    AVCodecContext *gap_avctx;      // daipozhi modified for gapless, decoder of the next file, taken at deb_gap_pkt
+    int64_t gap_start_pts;          // under queue->mutex, read_thread() may drop it again
+    AVRational gap_start_pts_tb;
+    int gap_track;
+    int track;
+    int hidden;                     // daipozhi modified, video is covered and only keyframes are decoded
+    enum AVDiscard skip_frame;      // skip_frame of the decoder before it was covered
+    int64_t seek_to;                // daipozhi modified, accurate seek: frames of seek_serial before
+    int seek_serial;                // this pts (stream time base) are not shown
+    int seek_skipping;              // non-reference frames are skipped for the packet being decoded
+    enum AVDiscard seek_skip_frame; // skip_frame to go back to at the target
 } Decoder;
 
+/* daipozhi modified, pictures that are not YUV420P are converted in
+   horizontal bands by a few threads, each band with its own SwsContext */
+#define SCALE_THREADS_MAX 8
+#define SCALE_BAND_MIN    64            // rows, a picture is not cut finer
+
+typedef struct ScaleBand {
+    struct ScalePool *pool;
+    int index;
+    struct SwsContext *ctx;
+    SDL_Thread *tid;                    // none for band 0, the caller converts it
+} ScaleBand;
+
+typedef struct ScalePool {
+    ScaleBand band[SCALE_THREADS_MAX];
+    int nb_bands;                       // 0 till the first picture
+    SDL_mutex *lock;                    // one picture at a time, the video and main threads share the pool
+    SDL_mutex *mutex;
+    SDL_cond *cond;                     // a new picture or abort
+    SDL_cond *done_cond;                // pending reached 0
+    int job;                            // counts pictures
+    int pending;                        // bands the threads have not finished
+    int abort;
+    AVFrame *src;                       // picture being converted
+    uint8_t *dst[4];
+    int dst_linesize[4];
+    int w, h, band_h;
+} ScalePool;
+
 typedef struct VideoState {
     SDL_Thread *read_tid;
     AVInputFormat *iformat;
@@ -284,6 +371,8 @@ typedef struct VideoState {
     struct SwrContext *swr_ctx;
     int frame_drops_early;
     int frame_drops_late;
+    int64_t seek_start;     // daipozhi modified, av_gettime_relative() of the seek till its first frame
+    int seek_ms;            // time the last seek took to show a frame
 
     enum ShowMode {
         SHOW_MODE_NONE = -1, SHOW_MODE_VIDEO = 0, SHOW_MODE_WAVES, SHOW_MODE_RDFT, SHOW_MODE_NB
@@ -308,10 +397,18 @@ typedef struct VideoState {
     AVStream *video_st;
     PacketQueue videoq;
     double max_frame_duration;      // maximum duration of a frame - above this, we consider the jump a timestamp discontinuity
-#if !CONFIG_AVFILTER
     struct SwsContext *img_convert_ctx;
-#endif
+    struct SwsContext *img_upload_ctx;  // main thread copy of img_convert_ctx for kept frames
+    ScalePool scale_pool;
     struct SwsContext *sub_convert_ctx;
+
+    /* daipozhi modified, overlays made ahead of time by the main thread, protected by pictq.mutex */
+    SDL_Overlay *spare_bmp[VIDEO_PICTURE_QUEUE_SIZE];
+    int nb_spare_bmp;
+    SDL_Overlay *retired_bmp[VIDEO_PICTURE_QUEUE_SIZE * 2];
+    int nb_retired_bmp;
+    int pic_req_w, pic_req_h;       // size the spares should have
+    int pic_req_pending;            // an FF_ALLOC_EVENT is on its way
     SDL_Rect last_display_rect;
     int eof;
 
@@ -331,6 +428,39 @@ typedef struct VideoState {
     int last_video_stream, last_audio_stream, last_subtitle_stream;
 
     SDL_cond *continue_read_thread;
+    SDL_mutex *continue_read_mutex;  // daipozhi modified, read_thread sleeps without timeout,
+    int continue_read;               // set with the signal so a wakeup is never lost
+
+    // daipozhi modified for gapless
+    // ic, audio_stream and audio_st are of the file being heard, the event thread uses them
+    // and changes them at FF_GAP_EVENT; read_thread() reads read_ic, which is already the
+    // next file while the tail of this one is still in the queues
+    AVFormatContext *read_ic;
+    int read_audio_stream;
+    AVStream *read_audio_st;
+    int read_track;                 // track of read_ic
+    int play_track;                 // track of ic
+    int seek_track;                 // play_track when the seek was asked, read_thread() goes back to it
+    GapTrack *gap_trk;              // input of each track, under deb_gap_mutex, closed by stream_close()
+    int gap_cnt;
+    AVFormatContext *gap_vic;       // input that holds video_st (the cover)
+    int gap_track;                  // track of the last frame the audio callback took
+
+    // daipozhi modified for automatic lowres
+    AVCodec *lowres_codec;          // video decoder
+    int lowres_cur;                 // lowres of the video decoder, or of the one handed over
+    int lowres_req;                 // lowres the window asks for, set by the main thread
+    int lowres_swap;                // read_thread still has to queue the hand over
+
+    // daipozhi modified for keyframe seek index, only touched by read_thread
+    int64_t *kidx_time;             // keyframe pts in AV_TIME_BASE, sorted
+    int64_t *kidx_pos;              // byte offset of the keyframe packet
+    int kidx_cnt, kidx_max;
+    int kidx_on;
+    int kidx_dirty;                 // entries were added since it was loaded
+    int kidx_stream;
+    int64_t kidx_size, kidx_mtime;  // of the file it indexes
+    char kidx_fn[3000];
 } VideoState;
 
 
@@ -349,6 +479,12 @@ typedef struct VideoState {
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <time.h>
+#if !defined(_WIN32) && !defined(__APPLE__)
+#include <sys/inotify.h>
+#endif
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
 
 
 // daipozhi modified 
@@ -364,7 +500,6 @@ static 	char      deb_scrn_str2[8001];
 
 
    // daipozhi modified
-static 	int    dpz_modi_ad_cnt=0;
 static 	int    deb_echo_str4seekbar(int y1,char *str);
 static 	int    deb_echo_str4screenstringblack(int xx,int yy,char *str,int len);
 static 	int    deb_echo_str4screenstring(int xx,int yy,char *str,int len);
@@ -392,6 +527,32 @@ static 	int    deb_filenamecnt;
 static 	int    deb_filenameplay;
 static 	char   deb_currentpath[3000];
 
+	// daipozhi modified for tree
+	// deb_filenamebuff*[] are row slots, display order is kept in deb_filenamerow[],
+	// a gap buffer of slot numbers, so open/close fold only moves int
+static  int    deb_filenamerow[10000];
+static  int    deb_filenamerow_gap;
+static  int    deb_filenamerow_free[10000];
+static  int    deb_filenamerow_freecnt;
+
+	// parent slot (-1 for top rows) and name span inside deb_filenamebuff[]
+static  int    deb_filenamebuff_parent[10000];
+static  short  deb_filenamebuff_name[10000];
+static  short  deb_filenamebuff_namelen[10000];
+
+	// duration column, filled by the probe threads; probe is 0 not asked, 1 queued, 2 done,
+	// stamp changes when a slot is reused so late results are dropped
+static  char   deb_filenamebuff_dur[10000][9];
+static  char   deb_filenamebuff_probe[10000];
+static  unsigned deb_filenamebuff_stamp[10000];
+
+static  int    deb_row(int pp);
+static  int    deb_row_ini(void);
+static  int    deb_row_gap_move(int pp);
+static  int    deb_row_insert(int pp);
+static  int    deb_row_delete(int pp);
+static  int    deb_row_set_name(int i,int parent);
+
 	// daipozhi modified 
 static 	int    deb_get_dir(void);
 static 	char   deb_lower(char c1);
@@ -400,11 +561,12 @@ static 	char   deb_upper(char c1);
 static 	int    deb_upper_string(char *p_instr);
 static 	int    deb_string2int(char *string,int p1,int p2);
 static 	int    deb_disp_dir(VideoState *is);
+static 	int    deb_disp_dir_valid;   // 0 when something else drew over the list
 static 	int    deb_disp_bar(VideoState *is);
 static  int    deb_utf8_to_gb18030(char *inbuffer,char *outbuffer,int outbufferlen);
 static 	int    deb_disp_scrn(VideoState *is);
 //static 	int    deb_filenameext(char *path,char *name,char *fext);
-static 	int    deb_filename_dir(char *path,char *name);
+static 	int    deb_filename_dir(char *path,int dfd,struct dirent *entry);
 
 static 	int deb_video_open_again(VideoState *is, int force_set_video_mode);
 //static 	int deb_ini_var(void);
@@ -454,8 +616,8 @@ static 	char deb_getfirstchar(char *buffer);
 static 	int deb_dir_add_after(int pp);
 static 	int deb_dir_remove_after(int pp);
 static 	int deb_get_path(int pp);
-static 	int deb_get_path1(char *buffer1,char *buffer2);
-static 	int deb_get_path2(char *buffer1,char *buffer2);
+static 	int deb_get_path_to(int pp,char *buffer);
+static 	int deb_get_slot_path(int slot,char *buffer);
 static 	int deb_cmp_dir(char *buffer1,char *buffer2);
 
 
@@ -466,6 +628,230 @@ static  char   deb_filenamebuff2_size[3000][7];
 static  char   deb_filenamebuff2_date[3000][20];
 static 	int    deb_filenamecnt2;
 
+	// daipozhi modified for reading folder in thread
+#define DEB_SCAN_BATCH 64
+
+static  SDL_Thread *deb_scan_tid;
+static  SDL_mutex  *deb_scan_mutex;
+static  SDL_cond   *deb_scan_cond;
+static  int    deb_scan_serial;          // changed by every start and cancel
+static  int    deb_scan_want;            // a new folder is waiting for the thread
+static  int    deb_scan_busy;            // the thread is in a folder, using bt_entry() and m202_*
+static  char   deb_scan_path[3000];
+static  int    deb_scan_slot=(-1);       // folder row being filled, -1 if none
+
+	// one batch, filled by the thread, taken by FF_DIR_EVENT
+static  int    deb_scan_bfull;
+static  int    deb_scan_bserial;
+static  int    deb_scan_bcnt;
+static  int    deb_scan_bdone;
+static  int    deb_scan_blen;
+static  char   deb_scan_btype;
+static  char   deb_scan_bname[DEB_SCAN_BATCH][1000];
+static  char   deb_scan_bkey[DEB_SCAN_BATCH][1002];
+static  char   deb_scan_bext[DEB_SCAN_BATCH][6];
+static  char   deb_scan_bsize[DEB_SCAN_BATCH][7];
+static  char   deb_scan_bdate[DEB_SCAN_BATCH][20];
+
+	// sort keys of the rows already in the folder, in display order
+static  char   deb_scan_key[3000][1002];
+static  int    deb_scan_keyord[3000];
+static  int    deb_scan_keycnt;
+
+static 	int deb_scan_init(void);
+static 	int deb_scan_thread(void *arg);
+static 	int deb_scan_start(int pp);
+static 	int deb_scan_cancel(void);
+static 	int deb_scan_wait(void);
+static 	int deb_scan_batch(VideoState *is);
+static 	int deb_row_find(int slot);
+
+	// daipozhi modified for folder cache
+	// sorted listings of folders read before, newest use wins,
+	// each listing is a run of [type][ext 6][name 0]
+#define DEB_DCACHE_NUM   32
+#define DEB_DCACHE_BYTES (8*1024*1024)
+
+static  char   deb_dcache_path[DEB_DCACHE_NUM][3000];
+static  char  *deb_dcache_buff[DEB_DCACHE_NUM];
+static  int    deb_dcache_bytes[DEB_DCACHE_NUM];
+static  int    deb_dcache_cnt[DEB_DCACHE_NUM];
+static  int    deb_dcache_len[DEB_DCACHE_NUM];
+static  char   deb_dcache_type[DEB_DCACHE_NUM];
+static  int    deb_dcache_used[DEB_DCACHE_NUM];
+static  int    deb_dcache_wd[DEB_DCACHE_NUM];
+static  time_t deb_dcache_mtime[DEB_DCACHE_NUM];
+static  int    deb_dcache_total;
+static  int    deb_dcache_tick;
+static  int    deb_dcache_ifd=(-1);
+
+static 	int deb_dcache_init(void);
+static 	int deb_dcache_drop(int i);
+static 	int deb_dcache_notify(void);
+static 	int deb_dcache_put(char *path,int pp);
+static 	int deb_dcache_get(char *path,int pp);
+
+	// daipozhi modified for media library
+	// ./library/roots.txt lists the folders to crawl, one per line,
+	// ./library/index.data is the index: head, records, folders sorted by path, strings.
+	// children of a folder are stored together, sorted like the browser
+#define DEB_LIB_VERSION 1
+#define DEB_LIB_RESCAN  600
+
+typedef struct DebLibHead {
+    char     magic[4];
+    int32_t  version;
+    int32_t  rec_cnt;
+    int32_t  fold_cnt;
+    int32_t  root_cnt;
+    int32_t  pad;
+    int64_t  str_size;
+} DebLibHead;
+
+typedef struct DebLibRec {
+    int64_t  size;
+    int64_t  mtime;
+    uint32_t name;
+    uint32_t key;
+    uint32_t path;         // folders only
+    int32_t  parent;
+    int32_t  child;        // folders only, first child record
+    int32_t  child_cnt;    // folders only, -1 not read, -2 link not followed
+    int32_t  type;         // 0 folder, 1 file
+    int32_t  pad;
+} DebLibRec;
+
+typedef struct DebLibIndex {
+    char       *base;
+    int64_t     size;
+    DebLibHead *head;
+    DebLibRec  *rec;
+    int32_t    *fold;
+    char       *str;
+} DebLibIndex;
+
+static  DebLibIndex deb_lib;
+static  SDL_Thread *deb_lib_tid;
+static  int         deb_lib_serial;
+static  char        deb_lib_home[3000];
+
+static 	int deb_lib_init(void);
+static 	int deb_lib_reload(void);
+
+	// daipozhi modified for keyframe seek index
+	// containers without an index (mpeg-ps, mpeg-ts) seek by
+	// bisecting the file on timestamps; the keyframes read while playing are
+	// kept in ./library/seek/<hash of path>.idx and a later seek to a time
+	// that is indexed goes to the byte offset directly
+#define DEB_KIDX_VERSION  1
+#define DEB_KIDX_MAX      65536
+#define DEB_KIDX_GAP      AV_TIME_BASE          // one entry per second is enough
+#define DEB_KIDX_NEAR     (20 * AV_TIME_BASE)   // further from the target the demuxer seeks itself
+
+typedef struct DebKidxHead {
+    char     magic[4];
+    int32_t  version;
+    int32_t  cnt;
+    int32_t  pad;
+    int64_t  size;
+    int64_t  mtime;
+} DebKidxHead;
+
+static 	int deb_kidx_open(VideoState *is);
+static 	int deb_kidx_add(VideoState *is,AVPacket *pkt);
+static 	int deb_kidx_find(VideoState *is,int64_t target,int64_t min,int64_t max,int64_t *pos);
+static 	int deb_kidx_close(VideoState *is);
+static 	int deb_lib_map(DebLibIndex *lib,char *fn);
+static 	int deb_lib_unmap(DebLibIndex *lib);
+static 	int deb_lib_find(DebLibIndex *lib,char *path);
+static 	int deb_lib_get(char *path,int pp);
+
+	// daipozhi modified for media probe
+	// a few threads open media files of the rows on and near the screen,
+	// results are kept in ./library/probe.data by path, size and time
+#define DEB_PROBE_THREADS 4
+#define DEB_PROBE_QUEUE   128
+#define DEB_PROBE_HASH    65536
+
+static  SDL_Thread *deb_probe_tid[DEB_PROBE_THREADS];
+static  SDL_mutex  *deb_probe_mutex;
+static  SDL_cond   *deb_probe_cond;
+static  SDL_cond   *deb_probe_cond2;
+static  FILE       *deb_probe_fp;
+
+static  int         deb_probe_jslot[DEB_PROBE_QUEUE];
+static  unsigned    deb_probe_jstamp[DEB_PROBE_QUEUE];
+static  char        deb_probe_jpath[DEB_PROBE_QUEUE][3000];
+static  int         deb_probe_jcnt;
+
+static  int         deb_probe_rslot[DEB_PROBE_QUEUE];
+static  unsigned    deb_probe_rstamp[DEB_PROBE_QUEUE];
+static  int64_t     deb_probe_rdur[DEB_PROBE_QUEUE];
+static  int         deb_probe_rcnt;
+static  int         deb_probe_posted;
+
+static  int         deb_probe_chash[DEB_PROBE_HASH];
+static  char      **deb_probe_cpath;
+static  int64_t    *deb_probe_csize;
+static  int64_t    *deb_probe_cmtime;
+static  int64_t    *deb_probe_cdur;
+static  int        *deb_probe_cnext;
+static  int         deb_probe_ccnt;
+static  int         deb_probe_cmax;
+
+static 	int deb_probe_init(void);
+static 	int deb_probe_view(int h);
+static 	int deb_probe_batch(VideoState *is);
+static 	int deb_dur_string(int64_t dur,char *buffer);
+
+	// daipozhi modified for search
+	// '/' starts it, rows are filtered as keys are typed. lower case names of the
+	// rows and of the library are kept in lists by every three bytes, so a query
+	// only reads the shortest list of its three bytes groups
+#define DEB_SEARCH_TRI  65536
+#define DEB_SEARCH_LIB  10000   // result ids from here are library records
+#define DEB_SEARCH_LEN  256
+
+typedef struct DebSearchTri {
+    int *post[DEB_SEARCH_TRI];
+    int  cnt[DEB_SEARCH_TRI];
+    int  max[DEB_SEARCH_TRI];
+    int  total;
+} DebSearchTri;
+
+static  int          deb_search_on;
+static  char         deb_search_str[DEB_SEARCH_LEN];
+static  char         deb_search_last[DEB_SEARCH_LEN];
+static  int          deb_search_last_ok;
+
+static  DebSearchTri deb_search_row;
+static  char        *deb_search_rkey[10000];
+static  unsigned     deb_search_rstamp[10000];
+static  unsigned     deb_search_rmark[10000];
+static  int          deb_search_radd;
+
+static  DebSearchTri deb_search_lib;
+static  char        *deb_search_lkey;
+static  int         *deb_search_loff;
+static  unsigned    *deb_search_lmark;
+static  int          deb_search_lcnt;
+static  int          deb_search_lserial;
+
+static  int         *deb_search_res;
+static  unsigned    *deb_search_resstamp;
+static  int          deb_search_rescnt;
+static  int          deb_search_resmax;
+static  int          deb_search_sel;
+static  int          deb_search_n;
+static  unsigned     deb_search_gen;
+
+static 	int deb_search_fill(int h,int w);
+static 	int deb_search_key(VideoState *is,SDL_keysym *key);
+static 	int deb_search_lib_drop(void);
+static 	int deb_search_lib_new(VideoState *is);
+static 	int deb_search_click(VideoState *is,int n2);
+static 	int deb_scan_now(int pp);
+
 
 static 	int deb_supported_formats(char *p_str);
 static 	int deb_filenameext2(char *path,char *fext);
@@ -475,17 +861,13 @@ static 	int deb_thr_r=0;
 
 static  int deb_str_has_null(char *s1,int s1_len);
 
-#if !defined(_WIN32) && !defined(__APPLE__)
-  static  struct stat64 deb_m_info;
-#else
-  static  struct stat   deb_m_info;
-#endif
-
-static  struct tm*    deb_m_info_tm;
 static  int           deb_m_info_len;
 static  char          deb_m_info_type;
 
 static int deb_size_format(int pn,char *buffer);
+static int deb_size_string(int64_t size,char *buffer);
+static int deb_date_string(time_t mtime,char *buffer);
+static int deb_row_meta(int pp);
 static int deb_get_dir_len(int pp);
 
 
@@ -586,6 +968,7 @@ static     int   out_list(char *pstr,char ptype,int pp);
 //static     int   search_2seper_cmp(int pp,int pl,int pc);
 //static     int   test2(void);
 
+static     int   bt_entry(char *path,int dfd,struct dirent *entry);
 static     int   bt_opendir(void);
 static     int   bt_readdir(void);
 //static     int   bt_findclose(void);
@@ -806,6 +1189,8 @@ static int64_t duration = AV_NOPTS_VALUE;
 static int fast = 0;
 static int genpts = 0;
 static int lowres = 0;
+static int scale_threads = 0;
+static int sub_id_count;
 static int decoder_reorder_pts = -1;
 
 
@@ -835,6 +1220,10 @@ static int nb_vfilters = 0;
 static char *afilters = NULL;
 #endif
 static int autorotate = 1;
+static int auto_lowres = 1;
+static int direct_render = 1;
+static int hidden_keyframes = 1;
+static int accurate_seek = 1;
 
 /* current context */
 static int is_full_screen;
@@ -844,6 +1233,107 @@ static AVPacket flush_pkt;
 
 #define FF_ALLOC_EVENT   (SDL_USEREVENT)
 #define FF_QUIT_EVENT    (SDL_USEREVENT + 2)
+#define FF_DIR_EVENT     (SDL_USEREVENT + 3)
+#define FF_LIB_EVENT     (SDL_USEREVENT + 4)
+#define FF_PROBE_EVENT   (SDL_USEREVENT + 5)
+#define FF_GAP_EVENT     (SDL_USEREVENT + 6)
+#define FF_WAKE_EVENT    (SDL_USEREVENT + 7)
+#define FF_SCRUB_EVENT   (SDL_USEREVENT + 8)
+
+	// daipozhi modified for gapless
+	// the next row is opened on a thread while this one plays; at end of file
+	// read_thread() puts it behind in the same audio queue, and deb_gap_pkt tells
+	// the audio decoder to change to its codec, so the sound does not stop
+static  AVPacket         deb_gap_pkt;
+static  SDL_Thread      *deb_gap_tid;
+static  SDL_mutex       *deb_gap_mutex;
+static  int              deb_gap_state;   // 0 none, 1 opening, 2 ready, 3 failed
+static  char             deb_gap_path[3000];
+static  int              deb_gap_slot;
+static  unsigned         deb_gap_stamp;
+static  AVFormatContext *deb_gap_ic;
+static  AVCodecContext  *deb_gap_avctx;
+static  int              deb_gap_stream;
+static  int              deb_gap_abort;   // deb_gap_drop() stops the opening thread
+
+static 	int deb_gap_start(VideoState *is);
+static 	int deb_gap_drop(void);
+static 	int deb_gap_take(VideoState *is,AVFormatContext **pic);
+static 	int deb_gap_back(VideoState *is,AVFormatContext **pic);
+static 	int deb_gap_next(VideoState *is,int track);
+
+	// daipozhi modified for seek bar preview
+	// while the left button holds the seek bar a thread with its own input and
+	// a lowres decoder shows the keyframe before the pointer above the bar,
+	// playback is seeked only when the button is let go
+#define DEB_SCRUB_W       160                   // preview width
+#define DEB_SCRUB_STEPS   400                   // positions over the whole bar
+#define DEB_SCRUB_CACHE   32                    // previews kept
+#define DEB_SCRUB_PKTS    500                   // packets read for one keyframe at most
+#define DEB_SCRUB_IDLE    10000                 // ms, the input is closed after this
+
+static  SDL_Thread      *deb_scrub_tid;
+static  SDL_mutex       *deb_scrub_mutex;
+static  SDL_cond        *deb_scrub_cond;
+static  int              deb_scrub_on;          // main thread, the button holds the bar
+static  int              deb_scrub_x;           // main thread, pointer position
+static  int64_t          deb_scrub_bucket;      // main thread, position of the preview asked for
+static  char             deb_scrub_path[3000];  // file previewed, with deb_scrub_mutex
+static  int              deb_scrub_file;        // counts files, with deb_scrub_mutex
+static  int              deb_scrub_want;        // file of the last request, -1 none, latest wins
+static  int64_t          deb_scrub_want_bucket;
+static  int64_t          deb_scrub_want_ts;
+static  int              deb_scrub_show;        // cache entry drawn, -1 none
+static  SDL_Surface     *deb_scrub_csurf[DEB_SCRUB_CACHE];
+static  int              deb_scrub_cfile[DEB_SCRUB_CACHE];
+static  int64_t          deb_scrub_cbucket[DEB_SCRUB_CACHE];
+static  unsigned         deb_scrub_cused[DEB_SCRUB_CACHE];
+static  unsigned         deb_scrub_clock;
+
+static 	int deb_scrub_begin(VideoState *is,int x);
+static 	int deb_scrub_move(VideoState *is,int x);
+static 	int deb_scrub_end(VideoState *is,int x,int seek);
+static 	int deb_scrub_draw(VideoState *is);
+static 	int deb_scrub_event(VideoState *is);
+static 	int deb_bar_seek(VideoState *is,int xx);
+
+	// daipozhi modified for event driven main loop
+	// the main thread sleeps on deb_wake_cond till the next timer is due; threads
+	// wake it with deb_post() (typed, a FF_WAKE_EVENT carries the code) or with
+	// deb_push_event(), input from SDL's event thread wakes it by the event filter
+#define DEB_WAKE_FRAME    1     // a picture was queued on an empty picture queue
+#define DEB_WAKE_READY    2     // a deb_thr_* thread got ready
+#define DEB_WAKE_SECOND   4     // the audio clock crossed a second
+
+#define DEB_TIMER_START   0     // end of the start delay, was 60 loops of deb_frame_num
+#define DEB_TIMER_VIDEO   1     // next video_refresh()
+#define DEB_TIMER_RIVER   2     // next sound river frame
+#define DEB_TIMER_BAR     3     // status bar, when no second boundary came
+#define DEB_TIMER_NB      4
+
+#define DEB_START_WAIT    0.6
+#define DEB_BAR_WAIT      1.5
+#if defined(_WIN32) || defined(__APPLE__)
+#define DEB_IDLE_WAIT     REFRESH_RATE  // no SDL event thread, input has to be pumped
+#else
+#define DEB_IDLE_WAIT     1.0
+#endif
+
+static  SDL_mutex       *deb_wake_mutex;
+static  SDL_cond        *deb_wake_cond;
+static  int              deb_wake_flag;
+static  int              deb_wake_pending;  // DEB_WAKE_* with a FF_WAKE_EVENT in the queue
+static  double           deb_timer[DEB_TIMER_NB];  // deadlines in seconds, 0 is off
+static  int              deb_bar_second=-1;
+
+static 	int deb_wake_init(void);
+static 	int deb_wake(void);
+static 	int deb_post(int code);
+static 	int deb_push_event(SDL_Event *event);
+static 	int deb_wake_wait(double t);
+static 	int deb_wake_event(int code);
+static 	double deb_timer_next(void);
+static 	int deb_timer_video(VideoState *is,double now);
 
 static SDL_Surface *screen;
 
@@ -877,6 +1367,28 @@ int64_t get_valid_channel_layout(int64_t channel_layout, int channels)
 }
 
 static void free_picture(Frame *vp);
+static double file_io_rate(AVFormatContext *ic);
+static void file_io_close_input(AVFormatContext **ps);
+static void video_lowres_check(VideoState *is);
+static void scale_pool_free(ScalePool *p);
+static void request_pictures(VideoState *is, int width, int height);
+static void upload_picture(VideoState *is, Frame *vp);
+static void duplicate_right_border_pixels(SDL_Overlay *bmp);
+
+/* daipozhi modified, watermarks in seconds of queued packets */
+static int packet_queue_has_enough(PacketQueue *q)
+{
+    if (!q->duration)
+        return q->nb_packets > MIN_FRAMES;
+    return q->time_base * q->duration >= q->target;
+}
+
+static int packet_queue_is_low(PacketQueue *q)
+{
+    if (!q->duration)
+        return q->nb_packets <= MIN_FRAMES;
+    return q->time_base * q->duration <= q->target * BUFFER_LOW_RATIO;
+}
 
 static int packet_queue_put_private(PacketQueue *q, AVPacket *pkt)
 {
@@ -885,9 +1397,15 @@ static int packet_queue_put_private(PacketQueue *q, AVPacket *pkt)
     if (q->abort_request)
        return -1;
 
-    pkt1 = av_malloc(sizeof(MyAVPacketList));
-    if (!pkt1)
-        return -1;
+    if (q->free_pkt) {
+        pkt1 = q->free_pkt;
+        q->free_pkt = pkt1->next;
+        q->alloc_avoided++;
+    } else {
+        pkt1 = av_malloc(sizeof(MyAVPacketList));
+        if (!pkt1)
+            return -1;
+    }
     pkt1->pkt = *pkt;
     pkt1->next = NULL;
     if (pkt == &flush_pkt)
@@ -902,8 +1420,18 @@ static int packet_queue_put_private(PacketQueue *q, AVPacket *pkt)
     q->nb_packets++;
     q->size += pkt1->pkt.size + sizeof(*pkt1);
     q->duration += pkt1->pkt.duration;
+    if (!q->filled && packet_queue_has_enough(q)) {
+        int64_t now = av_gettime_relative();
+        q->filled = 1;
+        /* no underrun for a while, give memory back */
+        if (q->target > BUFFER_MIN_SECONDS && now - q->last_underrun > BUFFER_DECAY_TIME) {
+            q->target = FFMAX(q->target * 0.75, BUFFER_MIN_SECONDS);
+            q->last_underrun = now;
+        }
+    }
     /* XXX: should duplicate packet data in DV case */
-    SDL_CondSignal(q->cond);
+    if (q->waiting)
+        SDL_CondSignal(q->cond);
     return 0;
 }
 
@@ -931,6 +1459,21 @@ static int packet_queue_put_nullpacket(PacketQueue *q, int stream_index)
     return packet_queue_put(q, pkt);
 }
 
+/* daipozhi modified, read_thread sleeps until one of these calls */
+static void read_thread_wake(VideoState *is)
+{
+    SDL_LockMutex(is->continue_read_mutex);
+    is->continue_read = 1;
+    SDL_CondSignal(is->continue_read_thread);
+    SDL_UnlockMutex(is->continue_read_mutex);
+}
+
+static void packet_queue_wake_reader(PacketQueue *q)
+{
+    if (q->is)
+        read_thread_wake(q->is);
+}
+
 /* packet queue handling */
 static int packet_queue_init(PacketQueue *q)
 {
@@ -946,6 +1489,7 @@ static int packet_queue_init(PacketQueue *q)
         return AVERROR(ENOMEM);
     }
     q->abort_request = 1;
+    q->target = BUFFER_MIN_SECONDS;
     return 0;
 }
 
@@ -957,19 +1501,29 @@ static void packet_queue_flush(PacketQueue *q)
     for (pkt = q->first_pkt; pkt; pkt = pkt1) {
         pkt1 = pkt->next;
         av_packet_unref(&pkt->pkt);
-        av_freep(&pkt);
+        pkt->next = q->free_pkt;
+        q->free_pkt = pkt;
     }
     q->last_pkt = NULL;
     q->first_pkt = NULL;
     q->nb_packets = 0;
     q->size = 0;
     q->duration = 0;
+    q->filled = 0;
     SDL_UnlockMutex(q->mutex);
 }
 
 static void packet_queue_destroy(PacketQueue *q)
 {
+    MyAVPacketList *pkt, *pkt1;
+
     packet_queue_flush(q);
+    for (pkt = q->free_pkt; pkt; pkt = pkt1) {
+        pkt1 = pkt->next;
+        av_free(pkt);
+    }
+    q->free_pkt = NULL;
+    av_log(NULL, AV_LOG_DEBUG, "packet queue: %"PRId64" node allocations avoided\n", q->alloc_avoided);
     SDL_DestroyMutex(q->mutex);
     SDL_DestroyCond(q->cond);
 }
@@ -997,7 +1551,7 @@ static void packet_queue_start(PacketQueue *q)
 static int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block, int *serial)
 {
     MyAVPacketList *pkt1;
-    int ret;
+    int ret, low = 0;
 
     SDL_LockMutex(q->mutex);
 
@@ -1018,26 +1572,94 @@ static int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block, int *seria
             *pkt = pkt1->pkt;
             if (serial)
                 *serial = pkt1->serial;
-            av_free(pkt1);
+            pkt1->next = q->free_pkt;
+            q->free_pkt = pkt1;
             ret = 1;
+            /* daipozhi modified, wake read_thread at the low watermark */
+            low = packet_queue_is_low(q);
             break;
         } else if (!block) {
             ret = 0;
             break;
         } else {
+            /* daipozhi modified, ran dry while the file goes on: the disk or
+               network could not keep up with this much buffer, ask for more.
+               Subtitles are sparse and run dry after every line, not grown */
+            if (q->filled && q->is && q != &q->is->subtitleq && !q->is->eof && q->target < BUFFER_MAX_SECONDS) {
+                q->target = FFMIN(q->target * 2, BUFFER_MAX_SECONDS);
+                q->last_underrun = av_gettime_relative();
+                av_log(NULL, AV_LOG_VERBOSE, "packet queue underrun, buffering %.0f s\n", q->target);
+            }
+            q->filled = 0;
+            q->waiting = 1;
             SDL_CondWait(q->cond, q->mutex);
+            q->waiting = 0;
         }
     }
     SDL_UnlockMutex(q->mutex);
+    if (low)
+        packet_queue_wake_reader(q);
     return ret;
 }
 
-static void decoder_init(Decoder *d, AVCodecContext *avctx, PacketQueue *queue, SDL_cond *empty_queue_cond) {
+static void decoder_init(Decoder *d, AVCodecContext *avctx, PacketQueue *queue) {
     memset(d, 0, sizeof(Decoder));
     d->avctx = avctx;
     d->queue = queue;
-    d->empty_queue_cond = empty_queue_cond;
     d->start_pts = AV_NOPTS_VALUE;
+    d->seek_to = AV_NOPTS_VALUE;
+}
+
+/* daipozhi modified, while the file list covers the video (deb_cover_close)
+   nobody sees the pictures, so only keyframes are decoded. When the video is
+   shown again the decoder goes back to full decoding at the next keyframe,
+   the audio keeps playing and no seek is needed. */
+static void decoder_hide_video(Decoder *d, AVPacket *pkt)
+{
+    if (hidden_keyframes && deb_cover_close == 1) {
+        if (!d->hidden) {
+            d->hidden = 1;
+            d->skip_frame = d->avctx->skip_frame;
+        }
+        /* set on every packet, a gapless switch brings in a fresh avctx */
+        d->avctx->skip_frame = FFMAX(d->skip_frame, AVDISCARD_NONKEY);
+    } else if (d->hidden && (pkt->flags & AV_PKT_FLAG_KEY)) {
+        d->avctx->skip_frame = d->skip_frame;
+        d->hidden = 0;
+    }
+}
+
+/* daipozhi modified, accurate seek. The demuxer lands on the keyframe before
+   the target, the frames from there to the target are decoded only as far as
+   later frames need them: packets before the target skip non-reference frames
+   and get_video_frame() drops what comes out before it, so they are never
+   filtered, copied to an overlay or blended with subtitles. The sound is cut
+   at the target by audio_seek_trim(), or the audio clock, the master, would
+   hold the picture till the keyframe's lead-in has been heard. Set by
+   read_thread before the flush packet of the seek is queued. */
+static void decoder_seek_to(Decoder *d, int64_t target, int serial)
+{
+    d->seek_to = target;
+    avpriv_atomic_int_set(&d->seek_serial, serial);
+}
+
+static void decoder_seek_skip(Decoder *d, AVPacket *pkt)
+{
+    int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+    int skip = d->seek_to != AV_NOPTS_VALUE && d->pkt_serial == d->seek_serial &&
+               ts != AV_NOPTS_VALUE && ts < d->seek_to;
+
+    if (skip) {
+        if (!d->seek_skipping) {
+            d->seek_skipping = 1;
+            /* while covered the setting to go back to is the one saved by decoder_hide_video() */
+            d->seek_skip_frame = d->hidden ? d->skip_frame : d->avctx->skip_frame;
+        }
+        d->avctx->skip_frame = FFMAX(d->avctx->skip_frame, AVDISCARD_NONREF);
+    } else if (d->seek_skipping) {
+        d->avctx->skip_frame = d->hidden ? FFMAX(d->seek_skip_frame, AVDISCARD_NONKEY) : d->seek_skip_frame;
+        d->seek_skipping = 0;
+    }
 }
 
 static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
@@ -1052,8 +1674,6 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
         if (!d->packet_pending || d->queue->serial != d->pkt_serial) {
             AVPacket pkt;
             do {
-                if (d->queue->nb_packets == 0)
-                    SDL_CondSignal(d->empty_queue_cond);
                 if (packet_queue_get(d->queue, &pkt, 1, &d->pkt_serial) < 0)
                     return -1;
                 if (pkt.data == flush_pkt.data) {
@@ -1062,7 +1682,26 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
                     d->next_pts = d->start_pts;
                     d->next_pts_tb = d->start_pts_tb;
                 }
-            } while (pkt.data == flush_pkt.data || d->queue->serial != d->pkt_serial);
+                if (pkt.data == deb_gap_pkt.data) { // daipozhi modified for gapless
+                    SDL_LockMutex(d->queue->mutex);
+                    if (d->gap_avctx) {
+                        avcodec_free_context(&d->avctx);
+                        d->avctx = d->gap_avctx;
+                        d->gap_avctx = NULL;
+                        d->finished = 0;
+                        d->start_pts = d->gap_start_pts;
+                        d->start_pts_tb = d->gap_start_pts_tb;
+                        d->next_pts = d->start_pts;
+                        d->next_pts_tb = d->start_pts_tb;
+                        d->track = d->gap_track;
+                    }
+                    SDL_UnlockMutex(d->queue->mutex);
+                }
+            } while (pkt.data == flush_pkt.data || pkt.data == deb_gap_pkt.data || d->queue->serial != d->pkt_serial);
+            if (d->avctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+                decoder_hide_video(d, &pkt);
+                decoder_seek_skip(d, &pkt);
+            }
             av_packet_unref(&d->pkt);
             d->pkt_temp = d->pkt = pkt;
             d->packet_pending = 1;
@@ -1118,6 +1757,7 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
                 if (!got_frame) {
                     d->packet_pending = 0;
                     d->finished = d->pkt_serial;
+                    packet_queue_wake_reader(d->queue);
                 }
             }
         }
@@ -1129,18 +1769,89 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
 static void decoder_destroy(Decoder *d) {
     av_packet_unref(&d->pkt);
     avcodec_free_context(&d->avctx);
+    avcodec_free_context(&d->gap_avctx);
+}
+
+/* daipozhi modified, direct rendering. SDL 1.2 can't wrap decoder memory in a
+   hardware overlay, but a software overlay's pixels/pitches arrays are the very
+   planes it converts from at display time, so they can be pointed at a
+   referenced decoder frame instead of copying it in. */
+static void frame_dr_detach(Frame *vp, int keep)
+{
+    uint8_t *data[4];
+    int linesize[4];
+    int i;
+
+    if (!vp->dr)
+        return;
+    for (i = 0; i < 3; i++) {
+        vp->bmp->pixels[i]  = vp->dr_pixels[i];
+        vp->bmp->pitches[i] = vp->dr_pitches[i];
+    }
+    vp->dr = 0;
+    if (keep) {
+        /* the picture is about to be drawn on, move it out of the decoder's buffer */
+        data[0] = vp->bmp->pixels[0];
+        data[1] = vp->bmp->pixels[2];
+        data[2] = vp->bmp->pixels[1];
+
+        linesize[0] = vp->bmp->pitches[0];
+        linesize[1] = vp->bmp->pitches[2];
+        linesize[2] = vp->bmp->pitches[1];
+
+        av_image_copy(data, linesize, (const uint8_t **)vp->frame->data, vp->frame->linesize,
+                      AV_PIX_FMT_YUV420P, vp->width, vp->height);
+        duplicate_right_border_pixels(vp->bmp);
+    }
+    av_frame_unref(vp->frame);
+}
+
+static int frame_dr_attach(VideoState *is, Frame *vp, AVFrame *src_frame)
+{
+    int i;
+
+    if (!direct_render || vp->bmp->hw_overlay || is->subtitle_st ||
+        src_frame->format != AV_PIX_FMT_YUV420P || !src_frame->buf[0])
+        return 0;
+    /* SDL's software YUV converter steps rows by w and w/2, not by pitches,
+       so only unpadded planes can be shown in place; an odd width would
+       also need duplicate_right_border_pixels() on the decoder's buffer */
+    if ((vp->width & 1) || src_frame->linesize[0] != vp->width ||
+        src_frame->linesize[1] != vp->width / 2 || src_frame->linesize[2] != vp->width / 2)
+        return 0;
+    if (av_frame_ref(vp->frame, src_frame) < 0)
+        return 0;
+
+    for (i = 0; i < 3; i++) {
+        vp->dr_pixels[i]  = vp->bmp->pixels[i];
+        vp->dr_pitches[i] = vp->bmp->pitches[i];
+    }
+    vp->bmp->pixels[0]  = vp->frame->data[0];
+    vp->bmp->pixels[1]  = vp->frame->data[2];
+    vp->bmp->pixels[2]  = vp->frame->data[1];
+    vp->bmp->pitches[0] = vp->frame->linesize[0];
+    vp->bmp->pitches[1] = vp->frame->linesize[2];
+    vp->bmp->pitches[2] = vp->frame->linesize[1];
+    vp->dr = 1;
+    return 1;
 }
 
 static void frame_queue_unref_item(Frame *vp)
 {
     int i;
+    frame_dr_detach(vp, 0);
     for (i = 0; i < vp->sub.num_rects; i++) {
         av_freep(&vp->subrects[i]->data[0]);
         av_freep(&vp->subrects[i]);
+        if (vp->subalpha)
+            av_freep(&vp->subalpha[i]);
     }
     av_freep(&vp->subrects);
+    av_freep(&vp->subalpha);
+    vp->sub_id = 0;
     av_frame_unref(vp->frame);
     avsubtitle_free(&vp->sub);
+    vp->upload = 0;
 }
 
 static int frame_queue_init(FrameQueue *f, PacketQueue *pktq, int max_size, int keep_last)
@@ -1202,12 +1913,17 @@ static Frame *frame_queue_peek_last(FrameQueue *f)
 static Frame *frame_queue_peek_writable(FrameQueue *f)
 {
     /* wait until we have space to put a new frame */
-    SDL_LockMutex(f->mutex);
-    while (f->size >= f->max_size &&
-           !f->pktq->abort_request) {
-        SDL_CondWait(f->cond, f->mutex);
+    if (avpriv_atomic_int_get(&f->size) >= f->max_size &&
+        !f->pktq->abort_request) {
+        SDL_LockMutex(f->mutex);
+        avpriv_atomic_int_set(&f->waiting, 1);
+        while (avpriv_atomic_int_get(&f->size) >= f->max_size &&
+               !f->pktq->abort_request) {
+            SDL_CondWait(f->cond, f->mutex);
+        }
+        avpriv_atomic_int_set(&f->waiting, 0);
+        SDL_UnlockMutex(f->mutex);
     }
-    SDL_UnlockMutex(f->mutex);
 
     if (f->pktq->abort_request)
         return NULL;
@@ -1218,12 +1934,17 @@ static Frame *frame_queue_peek_writable(FrameQueue *f)
 static Frame *frame_queue_peek_readable(FrameQueue *f)
 {
     /* wait until we have a readable a new frame */
-    SDL_LockMutex(f->mutex);
-    while (f->size - f->rindex_shown <= 0 &&
-           !f->pktq->abort_request) {
-        SDL_CondWait(f->cond, f->mutex);
+    if (avpriv_atomic_int_get(&f->size) - f->rindex_shown <= 0 &&
+        !f->pktq->abort_request) {
+        SDL_LockMutex(f->mutex);
+        avpriv_atomic_int_set(&f->waiting, 1);
+        while (avpriv_atomic_int_get(&f->size) - f->rindex_shown <= 0 &&
+               !f->pktq->abort_request) {
+            SDL_CondWait(f->cond, f->mutex);
+        }
+        avpriv_atomic_int_set(&f->waiting, 0);
+        SDL_UnlockMutex(f->mutex);
     }
-    SDL_UnlockMutex(f->mutex);
 
     if (f->pktq->abort_request)
         return NULL;
@@ -1235,10 +1956,12 @@ static void frame_queue_push(FrameQueue *f)
 {
     if (++f->windex == f->max_size)
         f->windex = 0;
-    SDL_LockMutex(f->mutex);
-    f->size++;
-    SDL_CondSignal(f->cond);
-    SDL_UnlockMutex(f->mutex);
+    avpriv_atomic_int_add_and_fetch(&f->size, 1);
+    if (avpriv_atomic_int_get(&f->waiting)) {
+        SDL_LockMutex(f->mutex);
+        SDL_CondSignal(f->cond);
+        SDL_UnlockMutex(f->mutex);
+    }
 }
 
 static void frame_queue_next(FrameQueue *f)
@@ -1250,16 +1973,21 @@ static void frame_queue_next(FrameQueue *f)
     frame_queue_unref_item(&f->queue[f->rindex]);
     if (++f->rindex == f->max_size)
         f->rindex = 0;
-    SDL_LockMutex(f->mutex);
-    f->size--;
-    SDL_CondSignal(f->cond);
-    SDL_UnlockMutex(f->mutex);
+    avpriv_atomic_int_add_and_fetch(&f->size, -1);
+    if (avpriv_atomic_int_get(&f->waiting)) {
+        SDL_LockMutex(f->mutex);
+        SDL_CondSignal(f->cond);
+        SDL_UnlockMutex(f->mutex);
+    }
+    /* daipozhi modified, drained at end of file, read_thread checks loop and autoexit */
+    if (avpriv_atomic_int_get(&f->size) == f->rindex_shown && f->pktq->nb_packets == 0)
+        packet_queue_wake_reader(f->pktq);
 }
 
 /* return the number of undisplayed frames in the queue */
 static int frame_queue_nb_remaining(FrameQueue *f)
 {
-    return f->size - f->rindex_shown;
+    return avpriv_atomic_int_get(&f->size) - f->rindex_shown;
 }
 
 /* return last shown position */
@@ -1350,13 +2078,126 @@ static void fill_border(int xleft, int ytop, int width, int height, int x, int y
 
 #define BPP 1
 
-static void blend_subrect(uint8_t **data, int *linesize, const AVSubtitleRect *rect, int imgw, int imgh)
+/* daipozhi modified, one row of ALPHA_BLEND(a, dst, src, 0). The vector
+   versions divide by 255 as (t + 1 + (t >> 8)) >> 8, which is exact for
+   t <= 255 * 255, so they give the same bytes as the C one. Runs that are
+   fully transparent, most of a subtitle bitmap, are skipped. */
+static void blend_row_c(uint8_t *dst, const uint8_t *src, const uint8_t *alpha, int w)
+{
+    int x;
+
+    for (x = 0; x < w; x++)
+        if (alpha[x])
+            dst[x] = ALPHA_BLEND(alpha[x], dst[x], src[x], 0);
+}
+
+#if HAVE_BLEND_SSE2
+static inline __m128i blend_epi16_sse2(__m128i d, __m128i s, __m128i a)
+{
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(255), a)),
+                              _mm_mullo_epi16(s, a));
+    t = _mm_add_epi16(t, _mm_add_epi16(_mm_srli_epi16(t, 8), _mm_set1_epi16(1)));
+    return _mm_srli_epi16(t, 8);
+}
+
+static void blend_row_sse2(uint8_t *dst, const uint8_t *src, const uint8_t *alpha, int w)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x;
+
+    for (x = 0; x + 16 <= w; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(alpha + x));
+        __m128i d, s, lo, hi;
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, zero)) == 0xFFFF)
+            continue;
+        d  = _mm_loadu_si128((const __m128i *)(dst + x));
+        s  = _mm_loadu_si128((const __m128i *)(src + x));
+        lo = blend_epi16_sse2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(a, zero));
+        hi = blend_epi16_sse2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(a, zero));
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(lo, hi));
+    }
+    blend_row_c(dst + x, src + x, alpha + x, w - x);
+}
+#endif
+
+#if HAVE_BLEND_AVX2
+__attribute__((target("avx2")))
+static inline __m256i blend_epi16_avx2(__m256i d, __m256i s, __m256i a)
+{
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(d, _mm256_sub_epi16(_mm256_set1_epi16(255), a)),
+                                 _mm256_mullo_epi16(s, a));
+    t = _mm256_add_epi16(t, _mm256_add_epi16(_mm256_srli_epi16(t, 8), _mm256_set1_epi16(1)));
+    return _mm256_srli_epi16(t, 8);
+}
+
+/* unpack and pack both work within 128-bit lanes, so bytes stay in order */
+__attribute__((target("avx2")))
+static void blend_row_avx2(uint8_t *dst, const uint8_t *src, const uint8_t *alpha, int w)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    int x;
+
+    for (x = 0; x + 32 <= w; x += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(alpha + x));
+        __m256i d, s, lo, hi;
+
+        if (_mm256_testz_si256(a, a))
+            continue;
+        d  = _mm256_loadu_si256((const __m256i *)(dst + x));
+        s  = _mm256_loadu_si256((const __m256i *)(src + x));
+        lo = blend_epi16_avx2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(a, zero));
+        hi = blend_epi16_avx2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(a, zero));
+        _mm256_storeu_si256((__m256i *)(dst + x), _mm256_packus_epi16(lo, hi));
+    }
+    blend_row_sse2(dst + x, src + x, alpha + x, w - x);
+}
+#endif
+
+static void (*blend_row)(uint8_t *dst, const uint8_t *src, const uint8_t *alpha, int w);
+
+static void blend_row_init(void)
+{
+    blend_row = blend_row_c;
+#if HAVE_BLEND_SSE2
+    blend_row = blend_row_sse2;
+#endif
+#if HAVE_BLEND_AVX2
+    if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+        blend_row = blend_row_avx2;
+#endif
+}
+
+/* daipozhi modified, the chroma planes are blended with the mean of the four
+   luma alphas each chroma sample covers. It is made once per subtitle by
+   subtitle_thread(), not again for every picture it is shown on. */
+static uint8_t *subrect_chroma_alpha(const AVSubtitleRect *rect)
+{
+    uint8_t *ca;
+    const uint8_t *a = rect->data[3];
+    int as = rect->linesize[3];
+    int w = rect->w / 2, h = rect->h / 2;
+    int x, y;
+
+    if (!(ca = av_malloc(FFMAX(w * h, 1))))
+        return NULL;
+    for (y = 0; y < h; y++)
+        for (x = 0; x < w; x++)
+            ca[x + y * w] = (a[2*x +  2*y   *as] + a[2*x + 1 +  2*y   *as] +
+                             a[2*x + 1 + (2*y+1)*as] + a[2*x + (2*y+1)*as]) >> 2;
+    return ca;
+}
+
+static void blend_subrect(uint8_t **data, int *linesize, const AVSubtitleRect *rect, const uint8_t *calpha, int imgw, int imgh)
 {
-    int x, y, Y, U, V, A;
+    int y;
     uint8_t *lum, *cb, *cr;
     int dstx, dsty, dstw, dsth;
     const AVSubtitleRect *src = rect;
 
+    if (!blend_row)
+        blend_row_init();
+
     dstw = av_clip(rect->w, 0, imgw);
     dsth = av_clip(rect->h, 0, imgh);
     dstx = av_clip(rect->x, 0, imgw - dstw);
@@ -1366,30 +2207,15 @@ static void blend_subrect(uint8_t **data, int *linesize, const AVSubtitleRect *r
     cr  = data[2] + dstx/2 + (dsty >> 1) * linesize[2];
 
     for (y = 0; y<dsth; y++) {
-        for (x = 0; x<dstw; x++) {
-            Y = src->data[0][x + y*src->linesize[0]];
-            A = src->data[3][x + y*src->linesize[3]];
-            lum[0] = ALPHA_BLEND(A, lum[0], Y, 0);
-            lum++;
-        }
-        lum += linesize[0] - dstw;
+        blend_row(lum, src->data[0] + y*src->linesize[0], src->data[3] + y*src->linesize[3], dstw);
+        lum += linesize[0];
     }
 
     for (y = 0; y<dsth/2; y++) {
-        for (x = 0; x<dstw/2; x++) {
-            U = src->data[1][x + y*src->linesize[1]];
-            V = src->data[2][x + y*src->linesize[2]];
-            A = src->data[3][2*x     +  2*y   *src->linesize[3]]
-              + src->data[3][2*x + 1 +  2*y   *src->linesize[3]]
-              + src->data[3][2*x + 1 + (2*y+1)*src->linesize[3]]
-              + src->data[3][2*x     + (2*y+1)*src->linesize[3]];
-            cb[0] = ALPHA_BLEND(A>>2, cb[0], U, 0);
-            cr[0] = ALPHA_BLEND(A>>2, cr[0], V, 0);
-            cb++;
-            cr++;
-        }
-        cb += linesize[1] - dstw/2;
-        cr += linesize[2] - dstw/2;
+        blend_row(cb, src->data[1] + y*src->linesize[1], calpha + y*(rect->w/2), dstw/2);
+        blend_row(cr, src->data[2] + y*src->linesize[2], calpha + y*(rect->w/2), dstw/2);
+        cb += linesize[1];
+        cr += linesize[2];
     }
 }
 
@@ -1466,12 +2292,16 @@ static void video_image_display(VideoState *is)
 
 
     vp = frame_queue_peek_last(&is->pictq);
+    if (vp->upload)
+        upload_picture(is, vp);
     if (vp->bmp) {
 
 
 
 
 	//daipozhi modified
+	deb_disp_dir_valid=0;
+
         if (deb_border==0)  
 	{
 		deb_border=1;
@@ -1487,10 +2317,13 @@ static void video_image_display(VideoState *is)
             if (frame_queue_nb_remaining(&is->subpq) > 0) {
                 sp = frame_queue_peek(&is->subpq);
 
-                if (vp->pts >= sp->pts + ((float) sp->sub.start_display_time / 1000)) {
+                /* daipozhi modified, a picture shown again already has it */
+                if (vp->pts >= sp->pts + ((float) sp->sub.start_display_time / 1000) &&
+                    vp->sub_id != sp->sub_id) {
                     uint8_t *data[4];
                     int linesize[4];
 
+                    frame_dr_detach(vp, 1);
                     SDL_LockYUVOverlay (vp->bmp);
 
                     data[0] = vp->bmp->pixels[0];
@@ -1502,8 +2335,9 @@ static void video_image_display(VideoState *is)
                     linesize[2] = vp->bmp->pitches[1];
 
                     for (i = 0; i < sp->sub.num_rects; i++)
-                        blend_subrect(data, linesize, sp->subrects[i],
+                        blend_subrect(data, linesize, sp->subrects[i], sp->subalpha[i],
                                       vp->bmp->w, vp->bmp->h);
+                    vp->sub_id = sp->sub_id;
 
                     SDL_UnlockYUVOverlay (vp->bmp);
                 }
@@ -1520,6 +2354,9 @@ static void video_image_display(VideoState *is)
             is->last_display_rect = rect;
         }
 
+        if (deb_scrub_on) //daipozhi modified
+            deb_scrub_draw(is);
+
 
 
 
@@ -1599,6 +2436,7 @@ static void video_audio_display(VideoState *s)
     }
 
     bgcolor = SDL_MapRGB(screen->format, 0x00, 0x00, 0x00);
+    deb_disp_dir_valid = 0; //daipozhi modified
     if (s->show_mode == SHOW_MODE_WAVES) {
         fill_rectangle(screen,
                        s->xleft, s->ytop, s->width, s->height,
@@ -1741,6 +2579,8 @@ static void stream_component_close(VideoState *is, int stream_index)
     case AVMEDIA_TYPE_AUDIO:
         is->audio_st = NULL;
         is->audio_stream = -1;
+        is->read_audio_st = NULL;
+        is->read_audio_stream = -1;
         break;
     case AVMEDIA_TYPE_VIDEO:
         is->video_st = NULL;
@@ -1757,32 +2597,66 @@ static void stream_component_close(VideoState *is, int stream_index)
 
 static void stream_close(VideoState *is)
 {
+    SDL_Event event;
+    int i;
+
     /* XXX: use a special url_shutdown call to abort parse cleanly */
     is->abort_request = 1;
+    if (is->continue_read_mutex)
+        read_thread_wake(is);
     SDL_WaitThread(is->read_tid, NULL);
 
     /* close each stream */
     if (is->audio_stream >= 0)
         stream_component_close(is, is->audio_stream);
-    if (is->video_stream >= 0)
+    if (is->video_stream >= 0) {
+        // daipozhi modified for gapless, the cover belongs to the first file
+        AVFormatContext *ic = is->ic;
+        if (is->gap_vic)
+            is->ic = is->gap_vic;
         stream_component_close(is, is->video_stream);
+        is->ic = ic;
+    }
     if (is->subtitle_stream >= 0)
         stream_component_close(is, is->subtitle_stream);
 
-    avformat_close_input(&is->ic);
+    deb_kidx_close(is); //daipozhi modified
+
+    //daipozhi modified for gapless, is->ic and read_ic are among the tracks
+    if (!is->gap_cnt)
+        file_io_close_input(&is->ic);
+    for (i = 0; i < is->gap_cnt; i++)
+        file_io_close_input(&is->gap_trk[i].ic);
+    av_freep(&is->gap_trk);
+    is->gap_cnt = 0;
+    is->ic = NULL;
+    is->read_ic = NULL;
+    is->gap_vic = NULL;
+    deb_gap_drop();
 
     packet_queue_destroy(&is->videoq);
     packet_queue_destroy(&is->audioq);
     packet_queue_destroy(&is->subtitleq);
 
+    /* the threads that post FF_ALLOC_EVENT are gone, drop what is left of
+       them before the spares go */
+    while (SDL_PeepEvents(&event, 1, SDL_GETEVENT, SDL_EVENTMASK(FF_ALLOC_EVENT)) > 0)
+        ;
+    for (i = 0; i < is->nb_spare_bmp; i++)
+        SDL_FreeYUVOverlay(is->spare_bmp[i]);
+    for (i = 0; i < is->nb_retired_bmp; i++)
+        SDL_FreeYUVOverlay(is->retired_bmp[i]);
+    is->nb_spare_bmp = is->nb_retired_bmp = 0;
+
     /* free all pictures */
     frame_queue_destory(&is->pictq);
     frame_queue_destory(&is->sampq);
     frame_queue_destory(&is->subpq);
     SDL_DestroyCond(is->continue_read_thread);
-#if !CONFIG_AVFILTER
+    SDL_DestroyMutex(is->continue_read_mutex);
     sws_freeContext(is->img_convert_ctx);
-#endif
+    sws_freeContext(is->img_upload_ctx);
+    scale_pool_free(&is->scale_pool);
     sws_freeContext(is->sub_convert_ctx);
 
 
@@ -1884,6 +2758,7 @@ static int video_open(VideoState *is, int force_set_video_mode, Frame *vp)
        && is->height== screen->h && screen->h == h && !force_set_video_mode)
         return 0;
     screen = SDL_SetVideoMode(w, h, 0, flags);
+    deb_disp_dir_valid = 0; //daipozhi modified
     if (!screen) {
         av_log(NULL, AV_LOG_FATAL, "SDL: could not set video mode - exiting\n");
         do_exit(is);
@@ -1909,6 +2784,8 @@ static int video_open(VideoState *is, int force_set_video_mode, Frame *vp)
     //daipozhi modified
     deb_ch_d= screen->h - deb_ch_h *( screen->h / deb_ch_h ) ;  
 
+    video_lowres_check(is);
+
 
 
 
@@ -2064,8 +2941,9 @@ static void stream_seek(VideoState *is, int64_t pos, int64_t rel, int seek_by_by
         is->seek_flags &= ~AVSEEK_FLAG_BYTE;
         if (seek_by_bytes)
             is->seek_flags |= AVSEEK_FLAG_BYTE;
+        is->seek_track = is->play_track;    // daipozhi modified for gapless, pos is in is->ic
         is->seek_req = 1;
-        SDL_CondSignal(is->continue_read_thread);
+        read_thread_wake(is);
     }
 }
 
@@ -2081,6 +2959,7 @@ static void stream_toggle_pause(VideoState *is)
     }
     set_clock(&is->extclk, get_clock(&is->extclk), is->extclk.serial);
     is->paused = is->audclk.paused = is->vidclk.paused = is->extclk.paused = !is->paused;
+    read_thread_wake(is);
 }
 
 static void toggle_pause(VideoState *is)
@@ -2250,6 +3129,11 @@ retry:
             frame_queue_next(&is->pictq);
             is->force_refresh = 1;
 
+            if (is->seek_start) {
+                is->seek_ms = (av_gettime_relative() - is->seek_start) / 1000;
+                is->seek_start = 0;
+            }
+
             if (is->step && !is->paused)
                 stream_toggle_pause(is);
         }
@@ -2263,7 +3147,7 @@ display:
         static int64_t last_time;
         int64_t cur_time;
         int aqsize, vqsize, sqsize;
-        double av_diff;
+        double av_diff, rate;
 
         cur_time = av_gettime_relative();
         if (!last_time || (cur_time - last_time) >= 30000) {
@@ -2283,8 +3167,9 @@ display:
                 av_diff = get_master_clock(is) - get_clock(&is->vidclk);
             else if (is->audio_st)
                 av_diff = get_master_clock(is) - get_clock(&is->audclk);
+            rate = file_io_rate(is->ic);
             av_log(NULL, AV_LOG_INFO,
-                   "%7.2f %s:%7.3f fd=%4d aq=%5dKB vq=%5dKB sq=%5dB f=%"PRId64"/%"PRId64"   \r",
+                   "%7.2f %s:%7.3f fd=%4d aq=%5dKB vq=%5dKB sq=%5dB rd=%6.1fMB/s sk=%4dms f=%"PRId64"/%"PRId64"   \r",
                    get_master_clock(is),
                    (is->audio_st && is->video_st) ? "A-V" : (is->video_st ? "M-V" : (is->audio_st ? "M-A" : "   ")),
                    av_diff,
@@ -2292,6 +3177,8 @@ display:
                    aqsize / 1024,
                    vqsize / 1024,
                    sqsize,
+                   rate,
+                   is->seek_ms,
                    is->video_st ? is->viddec.avctx->pts_correction_num_faulty_dts : 0,
                    is->video_st ? is->viddec.avctx->pts_correction_num_faulty_pts : 0);
             fflush(stdout);
@@ -2302,35 +3189,131 @@ display:
 
 /* allocate a picture (needs to do that in main thread to avoid
    potential locking problems */
-static void alloc_picture(VideoState *is)
+static SDL_Overlay *create_picture(VideoState *is, int width, int height)
 {
-    Frame *vp;
+    SDL_Overlay *bmp;
     int64_t bufferdiff;
 
-    vp = &is->pictq.queue[is->pictq.windex];
+    video_open(is, 0, NULL);
 
-    free_picture(vp);
-
-    video_open(is, 0, vp);
-
-    vp->bmp = SDL_CreateYUVOverlay(vp->width, vp->height,
-                                   SDL_YV12_OVERLAY,
-                                   screen);
-    bufferdiff = vp->bmp ? FFMAX(vp->bmp->pixels[0], vp->bmp->pixels[1]) - FFMIN(vp->bmp->pixels[0], vp->bmp->pixels[1]) : 0;
-    if (!vp->bmp || vp->bmp->pitches[0] < vp->width || bufferdiff < (int64_t)vp->height * vp->bmp->pitches[0]) {
+    bmp = SDL_CreateYUVOverlay(width, height,
+                               SDL_YV12_OVERLAY,
+                               screen);
+    bufferdiff = bmp ? FFMAX(bmp->pixels[0], bmp->pixels[1]) - FFMIN(bmp->pixels[0], bmp->pixels[1]) : 0;
+    if (!bmp || bmp->pitches[0] < width || bufferdiff < (int64_t)height * bmp->pitches[0]) {
         /* SDL allocates a buffer smaller than requested if the video
          * overlay hardware is unable to support the requested size. */
         av_log(NULL, AV_LOG_FATAL,
                "Error: the video system does not support an image\n"
                         "size of %dx%d pixels. Try using -lowres or -vf \"scale=w:h\"\n"
-                        "to reduce the image size.\n", vp->width, vp->height );
+                        "to reduce the image size.\n", width, height );
         do_exit(is);
     }
+    return bmp;
+}
+
+/* daipozhi modified, ask the main thread for a full set of overlays of the
+   given size, the caller does not wait for them */
+static void request_pictures(VideoState *is, int width, int height)
+{
+    SDL_Event event;
+    int post = 0;
+
+    SDL_LockMutex(is->pictq.mutex);
+    is->pic_req_w = width;
+    is->pic_req_h = height;
+    if (!is->pic_req_pending) {
+        is->pic_req_pending = 1;
+        post = 1;
+    }
+    SDL_UnlockMutex(is->pictq.mutex);
+
+    if (post) {
+        event.type = FF_ALLOC_EVENT;
+        event.user.data1 = is;
+        deb_push_event(&event);
+    }
+}
+
+/* runs in the main thread on FF_ALLOC_EVENT: frees the overlays the video
+   thread gave up and fills the spares up to the requested size */
+static void alloc_picture(VideoState *is)
+{
+    SDL_Overlay *old[VIDEO_PICTURE_QUEUE_SIZE * 3];
+    SDL_Overlay *bmp;
+    int nb_old, i, w, h, done;
+
+    for (;;) {
+        nb_old = 0;
+        SDL_LockMutex(is->pictq.mutex);
+        w = is->pic_req_w;
+        h = is->pic_req_h;
+        for (i = 0; i < is->nb_retired_bmp; i++)
+            old[nb_old++] = is->retired_bmp[i];
+        is->nb_retired_bmp = 0;
+        for (i = 0; i < is->nb_spare_bmp; ) {
+            if (is->spare_bmp[i]->w != w || is->spare_bmp[i]->h != h) {
+                old[nb_old++] = is->spare_bmp[i];
+                is->spare_bmp[i] = is->spare_bmp[--is->nb_spare_bmp];
+            } else
+                i++;
+        }
+        done = !w || !h || is->nb_spare_bmp >= is->pictq.max_size;
+        if (done)
+            is->pic_req_pending = 0;
+        SDL_UnlockMutex(is->pictq.mutex);
+
+        for (i = 0; i < nb_old; i++)
+            SDL_FreeYUVOverlay(old[i]);
+        if (done)
+            break;
+
+        bmp = create_picture(is, w, h);
+        SDL_LockMutex(is->pictq.mutex);
+        is->spare_bmp[is->nb_spare_bmp++] = bmp;
+        SDL_UnlockMutex(is->pictq.mutex);
+    }
+}
+
+/* video thread: swap a spare of the frame size into the slot being written,
+   returns 0 when none is ready yet */
+static int adopt_picture(VideoState *is, Frame *vp)
+{
+    SDL_Overlay *bmp = NULL;
+    SDL_Event event;
+    int i, post = 0;
 
     SDL_LockMutex(is->pictq.mutex);
-    vp->allocated = 1;
-    SDL_CondSignal(is->pictq.cond);
+    if (is->nb_retired_bmp < (int)FF_ARRAY_ELEMS(is->retired_bmp)) {
+        for (i = 0; i < is->nb_spare_bmp; i++) {
+            if (is->spare_bmp[i]->w == vp->width && is->spare_bmp[i]->h == vp->height) {
+                bmp = is->spare_bmp[i];
+                is->spare_bmp[i] = is->spare_bmp[--is->nb_spare_bmp];
+                break;
+            }
+        }
+    }
+    if (bmp) {
+        if (vp->bmp)
+            is->retired_bmp[is->nb_retired_bmp++] = vp->bmp;
+        vp->bmp = bmp;
+        vp->reallocate = 0;
+        /* last spare gone, let the main thread free what was retired */
+        if (!is->nb_spare_bmp && !is->pic_req_pending) {
+            is->pic_req_pending = 1;
+            post = 1;
+        }
+    }
     SDL_UnlockMutex(is->pictq.mutex);
+
+    if (post) {
+        event.type = FF_ALLOC_EVENT;
+        event.user.data1 = is;
+        deb_push_event(&event);
+    }
+    if (!bmp)
+        request_pictures(is, vp->width, vp->height);
+    return !!bmp;
 }
 
 static void duplicate_right_border_pixels(SDL_Overlay *bmp) {
@@ -2351,110 +3334,301 @@ static void duplicate_right_border_pixels(SDL_Overlay *bmp) {
     }
 }
 
-static int queue_picture(VideoState *is, AVFrame *src_frame, double pts, double duration, int64_t pos, int serial)
+static int scale_pool_format(enum AVPixelFormat fmt)
 {
-    Frame *vp;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
 
-#if defined(DEBUG_SYNC)
-    printf("frame_type=%c pts=%0.3f\n",
-           av_get_picture_type_char(src_frame->pict_type), pts);
-#endif
+    return desc && sws_isSupportedInput(fmt) &&
+           !(desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL |
+                            AV_PIX_FMT_FLAG_PSEUDOPAL | AV_PIX_FMT_FLAG_BITSTREAM));
+}
 
-    if (!(vp = frame_queue_peek_writable(&is->pictq)))
-        return -1;
+static int scale_pool_threads(void)
+{
+    return av_clip(scale_threads > 0 ? scale_threads : av_cpu_count(), 1, SCALE_THREADS_MAX);
+}
 
-    vp->sar = src_frame->sample_aspect_ratio;
+/* a band is converted as a picture of its own: rows band_h * index and on of
+   the source to the same rows of the overlay. Only chroma rows at a band
+   edge see another filter, and only when chroma is resampled vertically. */
+static void scale_band(ScaleBand *b)
+{
+    ScalePool *p = b->pool;
+    AVFrame *src = p->src;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(src->format);
+    uint8_t *data[4] = { NULL };
+    uint8_t *dst[4] = { NULL };
+    int y = b->index * p->band_h;
+    int h = FFMIN(p->band_h, p->h - y);
+    int i, shift;
+
+    if (h <= 0)
+        return;
 
-    /* alloc or resize hardware picture buffer */
-    if (!vp->bmp || vp->reallocate || !vp->allocated ||
-        vp->width  != src_frame->width ||
-        vp->height != src_frame->height) {
-        SDL_Event event;
+    for (i = 0; i < 4 && src->data[i]; i++) {
+        shift = (i == 1 || i == 2) ? desc->log2_chroma_h : 0;
+        data[i] = src->data[i] + (y >> shift) * src->linesize[i];
+    }
+    dst[0] = p->dst[0] + y * p->dst_linesize[0];
+    dst[1] = p->dst[1] + (y >> 1) * p->dst_linesize[1];
+    dst[2] = p->dst[2] + (y >> 1) * p->dst_linesize[2];
+
+    b->ctx = sws_getCachedContext(b->ctx,
+        p->w, h, src->format, p->w, h,
+        AV_PIX_FMT_YUV420P, sws_flags, NULL, NULL, NULL);
+    if (!b->ctx) {
+        av_log(NULL, AV_LOG_FATAL, "Cannot initialize the conversion context\n");
+        exit(1);
+    }
+    sws_scale(b->ctx, data, src->linesize, 0, h, dst, p->dst_linesize);
+}
 
-        vp->allocated  = 0;
-        vp->reallocate = 0;
-        vp->width = src_frame->width;
-        vp->height = src_frame->height;
+static int scale_thread(void *arg)
+{
+    ScaleBand *b = arg;
+    ScalePool *p = b->pool;
+    int job = 0;
 
-        /* the allocation must be done in the main thread to avoid
-           locking problems. */
-        event.type = FF_ALLOC_EVENT;
-        event.user.data1 = is;
-        SDL_PushEvent(&event);
+    SDL_LockMutex(p->mutex);
+    for (;;) {
+        while (!p->abort && p->job == job)
+            SDL_CondWait(p->cond, p->mutex);
+        if (p->abort)
+            break;
+        job = p->job;
+        SDL_UnlockMutex(p->mutex);
 
-        /* wait until the picture is allocated */
-        SDL_LockMutex(is->pictq.mutex);
-        while (!vp->allocated && !is->videoq.abort_request) {
-            SDL_CondWait(is->pictq.cond, is->pictq.mutex);
-        }
-        /* if the queue is aborted, we have to pop the pending ALLOC event or wait for the allocation to complete */
-        if (is->videoq.abort_request && SDL_PeepEvents(&event, 1, SDL_GETEVENT, SDL_EVENTMASK(FF_ALLOC_EVENT)) != 1) {
-            while (!vp->allocated && !is->abort_request) {
-                SDL_CondWait(is->pictq.cond, is->pictq.mutex);
-            }
-        }
-        SDL_UnlockMutex(is->pictq.mutex);
+        scale_band(b);
 
-        if (is->videoq.abort_request)
-            return -1;
+        SDL_LockMutex(p->mutex);
+        if (--p->pending == 0)
+            SDL_CondSignal(p->done_cond);
     }
+    SDL_UnlockMutex(p->mutex);
+    return 0;
+}
 
-    /* if the frame is not skipped, then display it */
-    if (vp->bmp) {
-        uint8_t *data[4];
-        int linesize[4];
-
-        /* get a pointer on the bitmap */
-        SDL_LockYUVOverlay (vp->bmp);
+static int scale_pool_init(ScalePool *p)
+{
+    memset(p, 0, sizeof(*p));
+    if (!(p->lock      = SDL_CreateMutex()) ||
+        !(p->mutex     = SDL_CreateMutex()) ||
+        !(p->cond      = SDL_CreateCond())  ||
+        !(p->done_cond = SDL_CreateCond()))
+        return AVERROR(ENOMEM);
+    return 0;
+}
 
-        data[0] = vp->bmp->pixels[0];
-        data[1] = vp->bmp->pixels[2];
-        data[2] = vp->bmp->pixels[1];
+/* the threads are started with the first picture that needs them, p->lock held */
+static void scale_pool_start(ScalePool *p)
+{
+    int i, n = scale_pool_threads();
+
+    p->band[0].pool = p;
+    p->nb_bands = 1;
+    for (i = 1; i < n; i++) {
+        p->band[i].pool  = p;
+        p->band[i].index = i;
+        if (!(p->band[i].tid = SDL_CreateThread(scale_thread, &p->band[i]))) {
+            av_log(NULL, AV_LOG_WARNING, "SDL_CreateThread(): %s\n", SDL_GetError());
+            break;
+        }
+        p->nb_bands++;
+    }
+}
 
-        linesize[0] = vp->bmp->pitches[0];
-        linesize[1] = vp->bmp->pitches[2];
-        linesize[2] = vp->bmp->pitches[1];
+static void scale_pool_free(ScalePool *p)
+{
+    int i;
 
-#if CONFIG_AVFILTER
-        // FIXME use direct rendering
+    if (p->mutex) {
+        SDL_LockMutex(p->mutex);
+        p->abort = 1;
+        SDL_CondBroadcast(p->cond);
+        SDL_UnlockMutex(p->mutex);
+    }
+    for (i = 0; i < SCALE_THREADS_MAX; i++) {
+        if (p->band[i].tid)
+            SDL_WaitThread(p->band[i].tid, NULL);
+        sws_freeContext(p->band[i].ctx);
+    }
+    SDL_DestroyCond(p->done_cond);
+    SDL_DestroyCond(p->cond);
+    SDL_DestroyMutex(p->mutex);
+    SDL_DestroyMutex(p->lock);
+    memset(p, 0, sizeof(*p));
+}
+
+/* convert src to the YUV420P planes dst on all threads, 0 if the picture is
+   better converted in one piece */
+static int scale_pool_run(ScalePool *p, AVFrame *src, uint8_t *dst[4], int dst_linesize[4], int w, int h)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(src->format);
+    int i, align;
+
+    if (!p->lock || h < SCALE_BAND_MIN * 2 || scale_pool_threads() < 2 || !scale_pool_format(src->format))
+        return 0;
+
+    SDL_LockMutex(p->lock);
+    if (!p->nb_bands)
+        scale_pool_start(p);
+
+    /* bands start on a row every chroma plane, source and overlay, starts on */
+    align = 1 << FFMAX(desc->log2_chroma_h, 1);
+    p->band_h = FFALIGN(FFMAX((h + p->nb_bands - 1) / p->nb_bands, SCALE_BAND_MIN), align);
+    p->src = src;
+    p->w   = w;
+    p->h   = h;
+    for (i = 0; i < 4; i++) {
+        p->dst[i]          = dst[i];
+        p->dst_linesize[i] = dst_linesize[i];
+    }
+
+    SDL_LockMutex(p->mutex);
+    p->pending = p->nb_bands - 1;
+    p->job++;
+    SDL_CondBroadcast(p->cond);
+    SDL_UnlockMutex(p->mutex);
+
+    scale_band(&p->band[0]);
+
+    SDL_LockMutex(p->mutex);
+    while (p->pending > 0)
+        SDL_CondWait(p->done_cond, p->mutex);
+    SDL_UnlockMutex(p->mutex);
+
+    p->src = NULL;
+    SDL_UnlockMutex(p->lock);
+    return 1;
+}
+
+static void fill_picture(VideoState *is, Frame *vp, AVFrame *src_frame, int upload)
+{
+    struct SwsContext **ctx = upload ? &is->img_upload_ctx : &is->img_convert_ctx;
+    uint8_t *data[4];
+    int linesize[4];
+
+    /* get a pointer on the bitmap */
+    SDL_LockYUVOverlay (vp->bmp);
+    vp->sub_id = 0;
+
+    if (frame_dr_attach(is, vp, src_frame))
+        goto picture_done;
+
+    data[0] = vp->bmp->pixels[0];
+    data[1] = vp->bmp->pixels[2];
+    data[2] = vp->bmp->pixels[1];
+
+    linesize[0] = vp->bmp->pitches[0];
+    linesize[1] = vp->bmp->pitches[2];
+    linesize[2] = vp->bmp->pitches[1];
+    data[3] = NULL;
+    linesize[3] = 0;
+
+    if (src_frame->format == AV_PIX_FMT_YUV420P) {
+        /* daipozhi modified, already the overlay's format, no need for swscale */
         av_image_copy(data, linesize, (const uint8_t **)src_frame->data, src_frame->linesize,
-                        src_frame->format, vp->width, vp->height);
-#else
-        {
-            AVDictionaryEntry *e = av_dict_get(sws_dict, "sws_flags", NULL, 0);
-            if (e) {
-                const AVClass *class = sws_get_class();
-                const AVOption    *o = av_opt_find(&class, "sws_flags", NULL, 0,
-                                                   AV_OPT_SEARCH_FAKE_OBJ);
-                int ret = av_opt_eval_flags(&class, o, e->value, &sws_flags);
-                if (ret < 0)
-                    exit(1);
-            }
+                      AV_PIX_FMT_YUV420P, vp->width, vp->height);
+    } else if (!scale_pool_run(&is->scale_pool, src_frame, data, linesize, vp->width, vp->height)) {
+        AVDictionaryEntry *e = av_dict_get(sws_dict, "sws_flags", NULL, 0);
+        if (e) {
+            const AVClass *class = sws_get_class();
+            const AVOption    *o = av_opt_find(&class, "sws_flags", NULL, 0,
+                                               AV_OPT_SEARCH_FAKE_OBJ);
+            int ret = av_opt_eval_flags(&class, o, e->value, &sws_flags);
+            if (ret < 0)
+                exit(1);
         }
 
-        is->img_convert_ctx = sws_getCachedContext(is->img_convert_ctx,
+        *ctx = sws_getCachedContext(*ctx,
             vp->width, vp->height, src_frame->format, vp->width, vp->height,
             AV_PIX_FMT_YUV420P, sws_flags, NULL, NULL, NULL);
-        if (!is->img_convert_ctx) {
+        if (!*ctx) {
             av_log(NULL, AV_LOG_FATAL, "Cannot initialize the conversion context\n");
             exit(1);
         }
-        sws_scale(is->img_convert_ctx, src_frame->data, src_frame->linesize,
+        sws_scale(*ctx, src_frame->data, src_frame->linesize,
                   0, vp->height, data, linesize);
+    }
+    /* workaround SDL PITCH_WORKAROUND */
+    duplicate_right_border_pixels(vp->bmp);
+picture_done:
+    /* update the bitmap content */
+    SDL_UnlockYUVOverlay(vp->bmp);
+}
+
+/* main thread: the video thread pushed this frame without an overlay of its
+   size, give it one now and copy the kept frame in */
+static void upload_picture(VideoState *is, Frame *vp)
+{
+    AVFrame *frame;
+    int i;
+
+    if (!vp->bmp || vp->reallocate ||
+        vp->bmp->w != vp->width || vp->bmp->h != vp->height) {
+        free_picture(vp);
+        SDL_LockMutex(is->pictq.mutex);
+        for (i = 0; i < is->nb_spare_bmp; i++) {
+            if (is->spare_bmp[i]->w == vp->width && is->spare_bmp[i]->h == vp->height) {
+                vp->bmp = is->spare_bmp[i];
+                is->spare_bmp[i] = is->spare_bmp[--is->nb_spare_bmp];
+                break;
+            }
+        }
+        SDL_UnlockMutex(is->pictq.mutex);
+        if (!vp->bmp)
+            vp->bmp = create_picture(is, vp->width, vp->height);
+        vp->reallocate = 0;
+    }
+
+    vp->upload = 0;
+    if (!(frame = av_frame_alloc())) {
+        av_frame_unref(vp->frame);
+        return;
+    }
+    av_frame_move_ref(frame, vp->frame);
+    fill_picture(is, vp, frame, 1);
+    av_frame_free(&frame);
+}
+
+static int queue_picture(VideoState *is, AVFrame *src_frame, double pts, double duration, int64_t pos, int serial)
+{
+    Frame *vp;
+
+#if defined(DEBUG_SYNC)
+    printf("frame_type=%c pts=%0.3f\n",
+           av_get_picture_type_char(src_frame->pict_type), pts);
 #endif
-        /* workaround SDL PITCH_WORKAROUND */
-        duplicate_right_border_pixels(vp->bmp);
-        /* update the bitmap content */
-        SDL_UnlockYUVOverlay(vp->bmp);
 
-        vp->pts = pts;
-        vp->duration = duration;
-        vp->pos = pos;
-        vp->serial = serial;
+    if (!(vp = frame_queue_peek_writable(&is->pictq)))
+        return -1;
 
-        /* now we can update the picture count */
-        frame_queue_push(&is->pictq);
+    vp->sar = src_frame->sample_aspect_ratio;
+    vp->width = src_frame->width;
+    vp->height = src_frame->height;
+
+    /* daipozhi modified, overlays are made ahead by the main thread. When the
+       size changes and no spare is ready the frame is kept as it is and
+       copied in at display time, so decoding never waits for the event loop */
+    if ((vp->bmp && !vp->reallocate &&
+         vp->bmp->w == vp->width && vp->bmp->h == vp->height) ||
+        adopt_picture(is, vp)) {
+        fill_picture(is, vp, src_frame, 0);
+    } else {
+        if (av_frame_ref(vp->frame, src_frame) < 0)
+            return 0;
+        vp->upload = 1;
     }
+
+    vp->pts = pts;
+    vp->duration = duration;
+    vp->pos = pos;
+    vp->serial = serial;
+
+    /* now we can update the picture count */
+    frame_queue_push(&is->pictq);
+    if (frame_queue_nb_remaining(&is->pictq) == 1)
+        deb_post(DEB_WAKE_FRAME);   // daipozhi modified, the main loop may be sleeping on an empty queue
     return 0;
 }
 
@@ -2476,6 +3650,16 @@ static int get_video_frame(VideoState *is, AVFrame *frame)
         is->viddec_width  = frame->width;
         is->viddec_height = frame->height;
 
+        /* daipozhi modified, accurate seek: nothing before the target is shown */
+        if (is->viddec.seek_to != AV_NOPTS_VALUE && is->viddec.pkt_serial == is->viddec.seek_serial &&
+            frame->pts != AV_NOPTS_VALUE) {
+            if (frame->pts + FFMAX(av_frame_get_pkt_duration(frame), 1) <= is->viddec.seek_to) {
+                av_frame_unref(frame);
+                return 0;
+            }
+            is->viddec.seek_to = AV_NOPTS_VALUE;
+        }
+
         if (framedrop>0 || (framedrop && get_master_sync_type(is) != AV_SYNC_VIDEO_MASTER)) {
             if (frame->pts != AV_NOPTS_VALUE) {
                 double diff = dpts - get_master_clock(is);
@@ -2540,7 +3724,9 @@ fail:
 
 static int configure_video_filters(AVFilterGraph *graph, VideoState *is, const char *vfilters, AVFrame *frame)
 {
-    static const enum AVPixelFormat pix_fmts[] = { AV_PIX_FMT_YUV420P, AV_PIX_FMT_NONE };
+    enum AVPixelFormat pix_fmts[256];
+    const AVPixFmtDescriptor *desc = NULL;
+    int nb_pix_fmts = 0;
     char sws_flags_str[512] = "";
     char buffersrc_args[256];
     int ret;
@@ -2580,6 +3766,17 @@ static int configure_video_filters(AVFilterGraph *graph, VideoState *is, const c
     if (ret < 0)
         goto fail;
 
+    /* daipozhi modified, what fill_picture() converts on several threads is
+       let through, in the graph it would be converted on one */
+    pix_fmts[nb_pix_fmts++] = AV_PIX_FMT_YUV420P;
+    while (scale_pool_threads() > 1 && nb_pix_fmts < FF_ARRAY_ELEMS(pix_fmts) - 1 &&
+           (desc = av_pix_fmt_desc_next(desc))) {
+        enum AVPixelFormat fmt = av_pix_fmt_desc_get_id(desc);
+        if (fmt != AV_PIX_FMT_YUV420P && scale_pool_format(fmt))
+            pix_fmts[nb_pix_fmts++] = fmt;
+    }
+    pix_fmts[nb_pix_fmts] = AV_PIX_FMT_NONE;
+
     if ((ret = av_opt_set_int_list(filt_out, "pix_fmts", pix_fmts,  AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN)) < 0)
         goto fail;
 
@@ -2711,6 +3908,41 @@ end:
 }
 #endif  /* CONFIG_AVFILTER */
 
+/* daipozhi modified, accurate seek: 1 when the frame is all before the target,
+   a frame across it loses the samples before it */
+static int audio_seek_trim(Decoder *d, AVFrame *frame)
+{
+    AVRational tb = (AVRational){1, frame->sample_rate};
+    int64_t target;
+    int i, n, planes, bytes;
+
+    if (d->seek_to == AV_NOPTS_VALUE || d->pkt_serial != d->seek_serial)
+        return 0;
+    if (frame->pts == AV_NOPTS_VALUE) {
+        d->seek_to = AV_NOPTS_VALUE;
+        return 0;
+    }
+
+    target = av_rescale_q(d->seek_to, av_codec_get_pkt_timebase(d->avctx), tb);
+    if (frame->pts + frame->nb_samples <= target)
+        return 1;
+
+    n = target - frame->pts;
+    if (n > 0) {
+        planes = av_sample_fmt_is_planar(frame->format) ? av_frame_get_channels(frame) : 1;
+        bytes  = av_get_bytes_per_sample(frame->format) * (planes == 1 ? av_frame_get_channels(frame) : 1) * n;
+        for (i = 0; i < planes; i++) {
+            frame->extended_data[i] += bytes;
+            if (frame->extended_data != frame->data && i < AV_NUM_DATA_POINTERS)
+                frame->data[i] += bytes;
+        }
+        frame->nb_samples -= n;
+        frame->pts        += n;
+    }
+    d->seek_to = AV_NOPTS_VALUE;
+    return 0;
+}
+
 static int audio_thread(void *arg)
 {
     VideoState *is = arg;
@@ -2733,6 +3965,10 @@ static int audio_thread(void *arg)
             goto the_end;
 
         if (got_frame) {
+                if (audio_seek_trim(&is->auddec, frame)) { //daipozhi modified
+                    av_frame_unref(frame);
+                    continue;
+                }
                 tb = (AVRational){1, frame->sample_rate};
 
 #if CONFIG_AVFILTER
@@ -2777,6 +4013,7 @@ static int audio_thread(void *arg)
                 af->pos = av_frame_get_pkt_pos(frame);
                 af->serial = is->auddec.pkt_serial;
                 af->duration = av_q2d((AVRational){frame->nb_samples, frame->sample_rate});
+                af->track = is->auddec.track;
 
                 av_frame_move_ref(af->frame, frame);
                 frame_queue_push(&is->sampq);
@@ -2793,7 +4030,11 @@ static int audio_thread(void *arg)
 
 
 
-	deb_thr_a=1;   //daipozhi modified
+	if (deb_thr_a==0) //daipozhi modified
+	{
+		deb_thr_a=1;
+		deb_post(DEB_WAKE_READY);
+	}
 
 
 
@@ -2875,7 +4116,7 @@ static int video_thread(void *arg)
                 SDL_Event event;
                 event.type = FF_QUIT_EVENT;
                 event.user.data1 = is;
-                SDL_PushEvent(&event);
+                deb_push_event(&event);
                 goto the_end;
             }
             filt_in  = is->in_video_filter;
@@ -2922,7 +4163,11 @@ static int video_thread(void *arg)
 
 
 
-	deb_thr_v=1;  //daipozhi modified 
+	if (deb_thr_v==0) //daipozhi modified
+	{
+		deb_thr_v=1;
+		deb_post(DEB_WAKE_READY);
+	}
 
 
 
@@ -2958,17 +4203,20 @@ static int subtitle_thread(void *arg)
                 pts = sp->sub.pts / (double)AV_TIME_BASE;
             sp->pts = pts;
             sp->serial = is->subdec.pkt_serial;
-            if (!(sp->subrects = av_mallocz_array(sp->sub.num_rects, sizeof(AVSubtitleRect*)))) {
+            if (!(sp->subrects = av_mallocz_array(sp->sub.num_rects, sizeof(AVSubtitleRect*))) ||
+                !(sp->subalpha = av_mallocz_array(sp->sub.num_rects, sizeof(uint8_t*)))) {
                 av_log(NULL, AV_LOG_FATAL, "Cannot allocate subrects\n");
                 exit(1);
             }
+            sp->sub_id = ++sub_id_count;
 
             for (i = 0; i < sp->sub.num_rects; i++)
             {
                 int in_w = sp->sub.rects[i]->w;
                 int in_h = sp->sub.rects[i]->h;
-                int subw = is->subdec.avctx->width  ? is->subdec.avctx->width  : is->viddec_width;
-                int subh = is->subdec.avctx->height ? is->subdec.avctx->height : is->viddec_height;
+                /* daipozhi modified, bitmaps are placed on the coded size, the decoder may output at lowres */
+                int subw = is->subdec.avctx->width  ? is->subdec.avctx->width  : is->video_st ? is->video_st->codecpar->width  : is->viddec_width;
+                int subh = is->subdec.avctx->height ? is->subdec.avctx->height : is->video_st ? is->video_st->codecpar->height : is->viddec_height;
                 int out_w = is->viddec_width  ? in_w * is->viddec_width  / subw : in_w;
                 int out_h = is->viddec_height ? in_h * is->viddec_height / subh : in_h;
 
@@ -2993,6 +4241,11 @@ static int subtitle_thread(void *arg)
                 sp->subrects[i]->h = out_h;
                 sp->subrects[i]->x = sp->sub.rects[i]->x * out_w / in_w;
                 sp->subrects[i]->y = sp->sub.rects[i]->y * out_h / in_h;
+
+                if (!(sp->subalpha[i] = subrect_chroma_alpha(sp->subrects[i]))) {
+                    av_log(NULL, AV_LOG_FATAL, "Cannot allocate subtitle data\n");
+                    exit(1);
+                }
             }
 
             /* now we can update the picture count */
@@ -3251,6 +4504,23 @@ static int audio_decode_frame(VideoState *is)
         frame_queue_next(&is->sampq);
     } while (af->serial != is->audioq.serial);
 
+    if (is->seek_start && !is->video_st) {
+        is->seek_ms = (av_gettime_relative() - is->seek_start) / 1000;
+        is->seek_start = 0;
+    }
+
+    // daipozhi modified for gapless, first sound of the next file
+    if (af->track != is->gap_track) {
+        SDL_Event event;
+
+        is->gap_track = af->track;
+
+        event.type = FF_GAP_EVENT;
+        event.user.code = af->track;
+        event.user.data1 = is;
+        deb_push_event(&event);
+    }
+
     data_size = av_samples_get_buffer_size(NULL, av_frame_get_channels(af->frame),
                                            af->frame->nb_samples,
                                            af->frame->format, 1);
@@ -3340,7 +4610,11 @@ static int audio_decode_frame(VideoState *is)
 
 
 
-	deb_thr_a2=1;   //daipozhi modified
+	if (deb_thr_a2==0) //daipozhi modified
+	{
+		deb_thr_a2=1;
+		deb_post(DEB_WAKE_READY);
+	}
 
 
 
@@ -3470,6 +4744,12 @@ Uint8 *stream2;
     if (!isnan(is->audio_clock)) {
         set_clock_at(&is->audclk, is->audio_clock - (double)(2 * is->audio_hw_buf_size + is->audio_write_buf_size) / is->audio_tgt.bytes_per_sec, is->audio_clock_serial, audio_callback_time / 1000000.0);
         sync_clock_to_slave(&is->extclk, &is->audclk);
+
+        // daipozhi modified, the status bar shows whole seconds
+        if ((int)is->audio_clock != deb_bar_second) {
+            deb_bar_second = (int)is->audio_clock;
+            deb_post(DEB_WAKE_SECOND);
+        }
     }
 
 
@@ -3604,6 +4884,94 @@ static int audio_open(void *opaque, int64_t wanted_channel_layout, int wanted_nb
     return spec.size;
 }
 
+/* daipozhi modified, automatic lowres. The largest lowres the decoder can do
+   that still decodes the picture at least as big as it is shown, so nothing
+   that would be seen is lost. -lowres turns it off. */
+static int video_auto_lowres(VideoState *is, AVStream *st, AVCodec *codec)
+{
+    SDL_Rect rect;
+    int w = st->codecpar->width;
+    int h = st->codecpar->height;
+    int l = 0;
+
+    if (lowres || !auto_lowres || !codec || w <= 0 || h <= 0 || is->width <= 0 || is->height <= 0)
+        return lowres;
+
+    calculate_display_rect(&rect, is->xleft, is->ytop, is->width, is->height, w, h,
+                           av_guess_sample_aspect_ratio(is->ic, st, NULL));
+
+    while (l < av_codec_get_max_lowres(codec) &&
+           (w >> (l + 1)) >= rect.w && (h >> (l + 1)) >= rect.h)
+        l++;
+    return l;
+}
+
+/* the window changed size, read_thread changes the decoder at the next keyframe */
+static void video_lowres_check(VideoState *is)
+{
+    if (!is || !is->video_st || !is->lowres_codec)
+        return;
+    is->lowres_req = video_auto_lowres(is, is->video_st, is->lowres_codec);
+}
+
+/* called by read_thread before a video keyframe is queued. A decoder for the
+   new lowres is opened here and handed over the way gapless audio does it:
+   the null packet drains the old decoder of its delayed pictures, at
+   deb_gap_pkt the video decoder takes the new one and starts on this
+   keyframe, so playback goes on without a seek. */
+static void video_lowres_switch(VideoState *is)
+{
+    AVStream *st = is->video_st;
+    AVCodecContext *avctx;
+    AVDictionary *opts;
+    int req = is->lowres_req;
+
+    if (req != is->lowres_cur && !is->viddec.gap_avctx) {
+        if (!(avctx = avcodec_alloc_context3(NULL)))
+            return;
+        if (avcodec_parameters_to_context(avctx, st->codecpar) < 0) {
+            avcodec_free_context(&avctx);
+            return;
+        }
+        av_codec_set_pkt_timebase(avctx, st->time_base);
+        avctx->codec_id = is->lowres_codec->id;
+        av_codec_set_lowres(avctx, req);
+#if FF_API_EMU_EDGE
+        if (req) avctx->flags |= CODEC_FLAG_EMU_EDGE;
+#endif
+        if (fast)
+            avctx->flags2 |= AV_CODEC_FLAG2_FAST;
+
+        opts = filter_codec_opts(codec_opts, avctx->codec_id, is->ic, st, is->lowres_codec);
+        if (!av_dict_get(opts, "threads", NULL, 0))
+            av_dict_set(&opts, "threads", "auto", 0);
+        av_dict_set_int(&opts, "lowres", req, 0);
+        av_dict_set(&opts, "refcounted_frames", "1", 0);
+        if (avcodec_open2(avctx, is->lowres_codec, &opts) < 0) {
+            av_dict_free(&opts);
+            avcodec_free_context(&avctx);
+            is->lowres_req = is->lowres_cur;    /* not again at every keyframe */
+            return;
+        }
+        av_dict_free(&opts);
+
+        av_log(NULL, AV_LOG_VERBOSE, "video decoder lowres %d -> %d\n", is->lowres_cur, req);
+
+        is->viddec.gap_start_pts    = is->viddec.start_pts;
+        is->viddec.gap_start_pts_tb = is->viddec.start_pts_tb;
+        is->viddec.gap_track        = is->viddec.track;
+        is->viddec.gap_avctx        = avctx;
+        is->lowres_cur  = req;
+        is->lowres_swap = 1;
+    }
+
+    if (is->lowres_swap) {
+        packet_queue_put_nullpacket(&is->videoq, is->video_stream);
+        packet_queue_put(&is->videoq, &deb_gap_pkt);
+        is->lowres_swap = 0;
+    }
+}
+
 /* open a given stream. Return 0 if OK */
 static int stream_component_open(VideoState *is, int stream_index)
 {
@@ -3649,6 +5017,8 @@ static int stream_component_open(VideoState *is, int stream_index)
     }
 
     avctx->codec_id = codec->id;
+    if (avctx->codec_type == AVMEDIA_TYPE_VIDEO) //daipozhi modified
+        stream_lowres = video_auto_lowres(is, ic->streams[stream_index], codec);
     if(stream_lowres > av_codec_get_max_lowres(codec)){
         av_log(avctx, AV_LOG_WARNING, "The maximum value for lowres supported by the decoder is %d\n",
                 av_codec_get_max_lowres(codec));
@@ -3724,8 +5094,12 @@ static int stream_component_open(VideoState *is, int stream_index)
 
         is->audio_stream = stream_index;
         is->audio_st = ic->streams[stream_index];
+        is->read_audio_stream = stream_index;
+        is->read_audio_st = is->audio_st;
+        is->audioq.time_base = av_q2d(is->audio_st->time_base);
 
-        decoder_init(&is->auddec, avctx, &is->audioq, is->continue_read_thread);
+        decoder_init(&is->auddec, avctx, &is->audioq);
+        is->auddec.track = is->read_track;  //daipozhi modified for gapless
         if ((is->ic->iformat->flags & (AVFMT_NOBINSEARCH | AVFMT_NOGENSEARCH | AVFMT_NO_BYTE_SEEK)) && !is->ic->iformat->read_seek) {
             is->auddec.start_pts = is->audio_st->start_time;
             is->auddec.start_pts_tb = is->audio_st->time_base;
@@ -3737,11 +5111,19 @@ static int stream_component_open(VideoState *is, int stream_index)
     case AVMEDIA_TYPE_VIDEO:
         is->video_stream = stream_index;
         is->video_st = ic->streams[stream_index];
+        is->videoq.time_base = av_q2d(is->video_st->time_base);
 
         is->viddec_width  = avctx->width;
         is->viddec_height = avctx->height;
 
-        decoder_init(&is->viddec, avctx, &is->videoq, is->continue_read_thread);
+        if (avctx->width > 0 && avctx->height > 0)
+            request_pictures(is, avctx->width, avctx->height);
+
+        is->lowres_codec = codec;
+        is->lowres_cur   = is->lowres_req = stream_lowres;
+        is->lowres_swap  = 0;
+
+        decoder_init(&is->viddec, avctx, &is->videoq);
         if ((ret = decoder_start(&is->viddec, video_thread, is)) < 0)
             goto out;
         is->queue_attachments_req = 1;
@@ -3749,8 +5131,9 @@ static int stream_component_open(VideoState *is, int stream_index)
     case AVMEDIA_TYPE_SUBTITLE:
         is->subtitle_stream = stream_index;
         is->subtitle_st = ic->streams[stream_index];
+        is->subtitleq.time_base = av_q2d(is->subtitle_st->time_base);
 
-        decoder_init(&is->subdec, avctx, &is->subtitleq, is->continue_read_thread);
+        decoder_init(&is->subdec, avctx, &is->subtitleq);
         if ((ret = decoder_start(&is->subdec, subtitle_thread, is)) < 0)
             goto out;
         break;
@@ -3767,6 +5150,163 @@ out:
     return ret;
 }
 
+/* daipozhi modified, local files are read through our own AVIOContext: big
+ * preads, sequential readahead asked from the kernel and, after a seek, the
+ * target region asked for before the demuxer needs it. mmap would save no
+ * copy here, the data is copied into the AVIOContext buffer either way, and
+ * a file on removable media would raise SIGBUS when it goes away. */
+#define FILE_IO_BUFFER   (256 * 1024)
+#define FILE_IO_PREFETCH (8 * 1024 * 1024)
+
+typedef struct FileIO {
+    int fd;
+    int64_t size;
+    int64_t pos;
+    int64_t prefetch_end;   /* end of the region the kernel was asked for */
+    int64_t bytes;          /* read so far */
+    int64_t read_time;      /* microseconds spent in pread() */
+} FileIO;
+
+static void file_io_prefetch(FileIO *f, int64_t pos)
+{
+#if !defined(_WIN32) && !defined(__APPLE__)
+    posix_fadvise(f->fd, pos, FILE_IO_PREFETCH, POSIX_FADV_WILLNEED);
+#endif
+    f->prefetch_end = pos + FILE_IO_PREFETCH;
+}
+
+static int file_io_read(void *opaque, uint8_t *buf, int buf_size)
+{
+    FileIO *f = opaque;
+    int64_t t = av_gettime_relative();
+    ssize_t n;
+
+    /* stay a window ahead of the demuxer */
+    if (f->pos + FILE_IO_PREFETCH / 2 >= f->prefetch_end && f->prefetch_end < f->size)
+        file_io_prefetch(f, FFMAX(f->pos, f->prefetch_end));
+
+    do {
+        n = pread(f->fd, buf, buf_size, f->pos);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+        return AVERROR(errno);
+    if (n == 0)
+        return AVERROR_EOF;
+
+    f->pos       += n;
+    f->bytes     += n;
+    f->read_time += av_gettime_relative() - t;
+    return n;
+}
+
+static int64_t file_io_seek(void *opaque, int64_t offset, int whence)
+{
+    FileIO *f = opaque;
+    int64_t pos;
+
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return f->size;
+    case SEEK_SET:
+        pos = offset;
+        break;
+    case SEEK_CUR:
+        pos = f->pos + offset;
+        break;
+    case SEEK_END:
+        pos = f->size + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (pos < 0)
+        return AVERROR(EINVAL);
+
+    /* out of the prefetched window, get the disk moving now */
+    if (pos < f->prefetch_end - FILE_IO_PREFETCH || pos >= f->prefetch_end)
+        file_io_prefetch(f, pos);
+    f->pos = pos;
+    return pos;
+}
+
+static void file_io_free(AVIOContext *pb)
+{
+    FileIO *f = pb->opaque;
+
+    close(f->fd);
+    av_free(f);
+    av_freep(&pb->buffer);
+    av_free(pb);
+}
+
+/* avformat_open_input(), with a FileIO for regular files */
+static int file_io_open_input(AVFormatContext **ps, const char *filename, AVInputFormat *fmt, AVDictionary **options)
+{
+    struct stat st;
+    AVIOContext *pb = NULL;
+    FileIO *f = NULL;
+    uint8_t *buffer = NULL;
+    int fd, ret;
+
+#if !defined(_WIN32)
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return avformat_open_input(ps, filename, fmt, options);
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+        !(f = av_mallocz(sizeof(*f))) ||
+        !(buffer = av_malloc(FILE_IO_BUFFER)) ||
+        !(pb = avio_alloc_context(buffer, FILE_IO_BUFFER, 0, f, file_io_read, NULL, file_io_seek)) ||
+        (!*ps && !(*ps = avformat_alloc_context()))) {
+        close(fd);
+        av_free(f);
+        av_free(buffer);
+        av_free(pb);
+        return avformat_open_input(ps, filename, fmt, options);
+    }
+
+    f->fd   = fd;
+    f->size = st.st_size;
+#if !defined(__APPLE__)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    file_io_prefetch(f, 0);
+
+    (*ps)->pb = pb;
+    ret = avformat_open_input(ps, filename, fmt, options);
+    if (ret < 0)
+        file_io_free(pb);
+    return ret;
+#else
+    return avformat_open_input(ps, filename, fmt, options);
+#endif
+}
+
+static void file_io_close_input(AVFormatContext **ps)
+{
+    AVIOContext *pb = NULL;
+
+    if (!*ps)
+        return;
+    if ((*ps)->flags & AVFMT_FLAG_CUSTOM_IO)
+        pb = (*ps)->pb;
+    avformat_close_input(ps);
+    if (pb)
+        file_io_free(pb);
+}
+
+/* disk throughput in MB/s for -stats, 0 when not read through FileIO */
+static double file_io_rate(AVFormatContext *ic)
+{
+    FileIO *f;
+
+    if (!ic || !(ic->flags & AVFMT_FLAG_CUSTOM_IO) || !ic->pb)
+        return 0;
+    f = ic->pb->opaque;
+    if (!f->read_time)
+        return 0;
+    return f->bytes / (double)f->read_time;
+}
+
 static int decode_interrupt_cb(void *ctx)
 {
     VideoState *is = ctx;
@@ -3777,7 +5317,16 @@ static int stream_has_enough_packets(AVStream *st, int stream_id, PacketQueue *q
     return stream_id < 0 ||
            queue->abort_request ||
            (st->disposition & AV_DISPOSITION_ATTACHED_PIC) ||
-           queue->nb_packets > MIN_FRAMES && (!queue->duration || av_q2d(st->time_base) * queue->duration > 1.0);
+           packet_queue_has_enough(queue);
+}
+
+/* daipozhi modified, more memory only for a file that has shown it needs it */
+static int queue_size_limit(VideoState *is)
+{
+    if (is->audioq.target > BUFFER_MIN_SECONDS ||
+        is->videoq.target > BUFFER_MIN_SECONDS)
+        return BUFFER_MAX_SIZE;
+    return MAX_QUEUE_SIZE;
 }
 
 static int is_realtime(AVFormatContext *s)
@@ -3796,6 +5345,19 @@ static int is_realtime(AVFormatContext *s)
     return 0;
 }
 
+/* sleep until read_thread_wake() or timeout ms, 0 is no timeout */
+static void read_thread_wait(VideoState *is, int timeout)
+{
+    SDL_LockMutex(is->continue_read_mutex);
+    if (!is->continue_read && !is->abort_request) {
+        if (timeout)
+            SDL_CondWaitTimeout(is->continue_read_thread, is->continue_read_mutex, timeout);
+        else
+            SDL_CondWait(is->continue_read_thread, is->continue_read_mutex);
+    }
+    SDL_UnlockMutex(is->continue_read_mutex);
+}
+
 /* this thread gets the stream from the disk or the network */
 static int read_thread(void *arg)
 {
@@ -3809,19 +5371,13 @@ static int read_thread(void *arg)
     AVDictionaryEntry *t;
     AVDictionary **opts;
     int orig_nb_streams;
-    SDL_mutex *wait_mutex = SDL_CreateMutex();
     int scan_all_pmts_set = 0;
     int64_t pkt_ts;
 
-    if (!wait_mutex) {
-        av_log(NULL, AV_LOG_FATAL, "SDL_CreateMutex(): %s\n", SDL_GetError());
-        ret = AVERROR(ENOMEM);
-        goto fail;
-    }
-
     memset(st_index, -1, sizeof(st_index));
     is->last_video_stream = is->video_stream = -1;
     is->last_audio_stream = is->audio_stream = -1;
+    is->read_audio_stream = -1;
     is->last_subtitle_stream = is->subtitle_stream = -1;
     is->eof = 0;
 
@@ -3837,7 +5393,7 @@ static int read_thread(void *arg)
         av_dict_set(&format_opts, "scan_all_pmts", "1", AV_DICT_DONT_OVERWRITE);
         scan_all_pmts_set = 1;
     }
-    err = avformat_open_input(&ic, is->filename, is->iformat, &format_opts);
+    err = file_io_open_input(&ic, is->filename, is->iformat, &format_opts);
     if (err < 0) {
         print_error(is->filename, err);
         ret = -1;
@@ -3852,6 +5408,7 @@ static int read_thread(void *arg)
         goto fail;
     }
     is->ic = ic;
+    is->read_ic = ic;   //daipozhi modified for gapless
 
     if (genpts)
         ic->flags |= AVFMT_FLAG_GENPTS;
@@ -3974,9 +5531,13 @@ static int read_thread(void *arg)
     if (infinite_buffer < 0 && is->realtime)
         infinite_buffer = 1;
 
+    deb_kidx_open(is); //daipozhi modified
+
     for (;;) {
         if (is->abort_request)
             break;
+        /* wakeups from here on are seen by read_thread_wait() */
+        avpriv_atomic_int_set(&is->continue_read, 0);
         if (is->paused != is->last_paused) {
             is->last_paused = is->paused;
             if (is->paused)
@@ -3998,17 +5559,34 @@ static int read_thread(void *arg)
             int64_t seek_target = is->seek_pos;
             int64_t seek_min    = is->seek_rel > 0 ? seek_target - is->seek_rel + 2: INT64_MIN;
             int64_t seek_max    = is->seek_rel < 0 ? seek_target - is->seek_rel - 2: INT64_MAX;
+            int64_t seek_pos;
 // FIXME the +-2 is due to rounding being not done in the correct direction in generation
 //      of the seek_pos/seek_rel variables
 
-            ret = avformat_seek_file(is->ic, -1, seek_min, seek_target, seek_max, is->seek_flags);
+            is->seek_start = av_gettime_relative();
+            //daipozhi modified for gapless, the seek is in the file being heard
+            if (is->seek_track != is->read_track)
+                deb_gap_back(is, &ic);
+            //daipozhi modified, an indexed keyframe is reached by its byte offset
+            if (!(is->seek_flags & AVSEEK_FLAG_BYTE) &&
+                deb_kidx_find(is, seek_target, seek_min, seek_max, &seek_pos) == 0)
+                ret = avformat_seek_file(ic, -1, seek_pos, seek_pos, seek_pos, AVSEEK_FLAG_BYTE);
+            else
+                ret = avformat_seek_file(ic, -1, seek_min, seek_target, seek_max, is->seek_flags);
             if (ret < 0) {
                 av_log(NULL, AV_LOG_ERROR,
-                       "%s: error while seeking\n", is->ic->filename);
+                       "%s: error while seeking\n", ic->filename);
             } else {
-                if (is->audio_stream >= 0) {
+                if (is->read_audio_stream >= 0) {
                     packet_queue_flush(&is->audioq);
+                    //daipozhi modified, the audio clock starts at the target too
+                    decoder_seek_to(&is->auddec,
+                                    accurate_seek && !(is->seek_flags & AVSEEK_FLAG_BYTE) ?
+                                    av_rescale_q(seek_target, AV_TIME_BASE_Q, is->read_audio_st->time_base) : AV_NOPTS_VALUE,
+                                    is->audioq.serial + 1);
                     packet_queue_put(&is->audioq, &flush_pkt);
+                    if (is->auddec.gap_avctx)  //daipozhi modified for gapless
+                        packet_queue_put(&is->audioq, &deb_gap_pkt);
                 }
                 if (is->subtitle_stream >= 0) {
                     packet_queue_flush(&is->subtitleq);
@@ -4016,7 +5594,15 @@ static int read_thread(void *arg)
                 }
                 if (is->video_stream >= 0) {
                     packet_queue_flush(&is->videoq);
+                    //daipozhi modified, the flush packet starts serial + 1
+                    decoder_seek_to(&is->viddec,
+                                    accurate_seek && !(is->seek_flags & AVSEEK_FLAG_BYTE) ?
+                                    av_rescale_q(seek_target, AV_TIME_BASE_Q, is->video_st->time_base) : AV_NOPTS_VALUE,
+                                    is->videoq.serial + 1);
                     packet_queue_put(&is->videoq, &flush_pkt);
+                    //daipozhi modified, a lowres hand over that was flushed is queued again
+                    if (is->viddec.gap_avctx)
+                        is->lowres_swap = 1;
                 }
                 if (is->seek_flags & AVSEEK_FLAG_BYTE) {
                    set_clock(&is->extclk, NAN, 0);
@@ -4043,18 +5629,16 @@ static int read_thread(void *arg)
 
         /* if the queue are full, no need to read more */
         if (infinite_buffer<1 &&
-              (is->audioq.size + is->videoq.size + is->subtitleq.size > MAX_QUEUE_SIZE
-            || (stream_has_enough_packets(is->audio_st, is->audio_stream, &is->audioq) &&
+              (is->audioq.size + is->videoq.size + is->subtitleq.size > queue_size_limit(is)
+            || (stream_has_enough_packets(is->read_audio_st, is->read_audio_stream, &is->audioq) &&
                 stream_has_enough_packets(is->video_st, is->video_stream, &is->videoq) &&
                 stream_has_enough_packets(is->subtitle_st, is->subtitle_stream, &is->subtitleq)))) {
-            /* wait 10 ms */
-            SDL_LockMutex(wait_mutex);
-            SDL_CondWaitTimeout(is->continue_read_thread, wait_mutex, 10);
-            SDL_UnlockMutex(wait_mutex);
+            /* wait till a queue drops below its watermark */
+            read_thread_wait(is, 0);
             continue;
         }
         if (!is->paused &&
-            (!is->audio_st || (is->auddec.finished == is->audioq.serial && frame_queue_nb_remaining(&is->sampq) == 0)) &&
+            (!is->read_audio_st || (is->auddec.finished == is->audioq.serial && !is->auddec.gap_avctx && frame_queue_nb_remaining(&is->sampq) == 0)) &&
             (!is->video_st || (is->viddec.finished == is->videoq.serial && frame_queue_nb_remaining(&is->pictq) == 0))) {
             if (loop != 1 && (!loop || --loop)) {
                 stream_seek(is, start_time != AV_NOPTS_VALUE ? start_time : 0, 0, 0);
@@ -4065,24 +5649,31 @@ static int read_thread(void *arg)
         }
         ret = av_read_frame(ic, pkt);
         if (ret < 0) {
+            //daipozhi modified for gapless, also when the next file was opened late
+            if ((ret == AVERROR_EOF || avio_feof(ic->pb)) && deb_gap_take(is, &ic) == 0) {
+                is->eof = 0;
+                continue;
+            }
             if ((ret == AVERROR_EOF || avio_feof(ic->pb)) && !is->eof) {
                 if (is->video_stream >= 0)
                     packet_queue_put_nullpacket(&is->videoq, is->video_stream);
-                if (is->audio_stream >= 0)
-                    packet_queue_put_nullpacket(&is->audioq, is->audio_stream);
+                if (is->read_audio_stream >= 0)
+                    packet_queue_put_nullpacket(&is->audioq, is->read_audio_stream);
                 if (is->subtitle_stream >= 0)
                     packet_queue_put_nullpacket(&is->subtitleq, is->subtitle_stream);
                 is->eof = 1;
             }
             if (ic->pb && ic->pb->error)
                 break;
-            SDL_LockMutex(wait_mutex);
-            SDL_CondWaitTimeout(is->continue_read_thread, wait_mutex, 10);
-            SDL_UnlockMutex(wait_mutex);
+            /* at the end a seek, the decoders finishing or the next file wakes
+               us, other errors may go away so they are retried */
+            read_thread_wait(is, is->eof ? 0 : 10);
             continue;
         } else {
             is->eof = 0;
         }
+        if (is->kidx_on) //daipozhi modified
+            deb_kidx_add(is, pkt);
         /* check if packet is in play range specified by user, then queue, otherwise discard */
         stream_start_time = ic->streams[pkt->stream_index]->start_time;
         pkt_ts = pkt->pts == AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
@@ -4091,10 +5682,12 @@ static int read_thread(void *arg)
                 av_q2d(ic->streams[pkt->stream_index]->time_base) -
                 (double)(start_time != AV_NOPTS_VALUE ? start_time : 0) / 1000000
                 <= ((double)duration / 1000000);
-        if (pkt->stream_index == is->audio_stream && pkt_in_play_range) {
+        if (pkt->stream_index == is->read_audio_stream && pkt_in_play_range) {
             packet_queue_put(&is->audioq, pkt);
         } else if (pkt->stream_index == is->video_stream && pkt_in_play_range
                    && !(is->video_st->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+            if ((is->lowres_req != is->lowres_cur || is->lowres_swap) && (pkt->flags & AV_PKT_FLAG_KEY))
+                video_lowres_switch(is); //daipozhi modified
             packet_queue_put(&is->videoq, pkt);
         } else if (pkt->stream_index == is->subtitle_stream && pkt_in_play_range) {
             packet_queue_put(&is->subtitleq, pkt);
@@ -4105,7 +5698,11 @@ static int read_thread(void *arg)
 
 
 
-	deb_thr_r=1;  //daipozhi modified 
+	if (deb_thr_r==0) //daipozhi modified
+	{
+		deb_thr_r=1;
+		deb_post(DEB_WAKE_READY);
+	}
 
 
 
@@ -4124,16 +5721,15 @@ static int read_thread(void *arg)
     ret = 0;
  fail:
     if (ic && !is->ic)
-        avformat_close_input(&ic);
+        file_io_close_input(&ic);
 
     if (ret != 0) {
         SDL_Event event;
 
         event.type = FF_QUIT_EVENT;
         event.user.data1 = is;
-        SDL_PushEvent(&event);
+        deb_push_event(&event);
     }
-    SDL_DestroyMutex(wait_mutex);
     return 0;
 }
 
@@ -4196,6 +5792,17 @@ static VideoState *stream_open(const char *filename, AVInputFormat *iformat,int
         av_log(NULL, AV_LOG_FATAL, "SDL_CreateCond(): %s\n", SDL_GetError());
         goto fail;
     }
+    if (!(stream_open_is->continue_read_mutex = SDL_CreateMutex())) {
+        av_log(NULL, AV_LOG_FATAL, "SDL_CreateMutex(): %s\n", SDL_GetError());
+        goto fail;
+    }
+    if (scale_pool_init(&stream_open_is->scale_pool) < 0) {
+        av_log(NULL, AV_LOG_FATAL, "SDL_CreateMutex(): %s\n", SDL_GetError());
+        goto fail;
+    }
+    stream_open_is->videoq.is    = stream_open_is;
+    stream_open_is->audioq.is    = stream_open_is;
+    stream_open_is->subtitleq.is = stream_open_is;
 
     init_clock(&stream_open_is->vidclk, &stream_open_is->videoq.serial);
     init_clock(&stream_open_is->audclk, &stream_open_is->audioq.serial);
@@ -4217,6 +5824,8 @@ fail:
 
 	deb_st_play=1;
 
+	deb_gap_start(stream_open_is);  //daipozhi modified for gapless
+
 
 
 
@@ -4234,6 +5843,10 @@ static void stream_cycle_channel(VideoState *is, int codec_type)
     AVProgram *p = NULL;
     int nb_streams = is->ic->nb_streams;
 
+    //daipozhi modified for gapless, not while the next file is read behind this one
+    if (is->play_track != is->read_track)
+        return;
+
     if (codec_type == AVMEDIA_TYPE_VIDEO) {
         start_index = is->last_video_stream;
         old_index = is->video_stream;
@@ -4301,6 +5914,7 @@ static void stream_cycle_channel(VideoState *is, int codec_type)
 
     stream_component_close(is, old_index);
     stream_component_open(is, stream_index);
+    read_thread_wake(is);
 }
 
 
@@ -4311,9 +5925,18 @@ static void toggle_full_screen(VideoState *is)
     int i;
     for (i = 0; i < VIDEO_PICTURE_QUEUE_SIZE; i++)
         is->pictq.queue[i].reallocate = 1;
+    SDL_LockMutex(is->pictq.mutex);
+    for (i = 0; i < is->nb_spare_bmp; i++)
+        SDL_FreeYUVOverlay(is->spare_bmp[i]);
+    is->nb_spare_bmp = 0;
+    SDL_UnlockMutex(is->pictq.mutex);
 #endif
     is_full_screen = !is_full_screen;
     video_open(is, 1, NULL);
+#if defined(__APPLE__) && SDL_VERSION_ATLEAST(1, 2, 14)
+    if (is->pic_req_w)
+        request_pictures(is, is->pic_req_w, is->pic_req_h);
+#endif
 }
 
 static void toggle_audio_display(VideoState *is)
@@ -4353,7 +5976,7 @@ static void refresh_loop_wait_event(VideoState *is, SDL_Event *event) {
 
 
 
-    double remaining_time = 0.0;
+    double remaining_time, now;
     SDL_PumpEvents();
     while (!SDL_PeepEvents(event, 1, SDL_GETEVENT, SDL_ALLEVENTS)) {
 
@@ -4369,9 +5992,14 @@ static void refresh_loop_wait_event(VideoState *is, SDL_Event *event) {
 
 
 
-        if (remaining_time > 0.0)
-            av_usleep((int64_t)(remaining_time * 1000000.0));
-        remaining_time = REFRESH_RATE;
+	//daipozhi modified, sleep till the next timer or a wakeup instead of every REFRESH_RATE
+	if (is->force_refresh) deb_timer[DEB_TIMER_VIDEO]=av_gettime_relative() / 1000000.0;
+
+	remaining_time=deb_timer_next();
+	if (remaining_time > 0.0)
+		deb_wake_wait(remaining_time);
+
+	now=av_gettime_relative() / 1000000.0;
 
 
 
@@ -4392,41 +6020,55 @@ static void refresh_loop_wait_event(VideoState *is, SDL_Event *event) {
 
 
 		//   daipozhi modified 
-		if (deb_st_play==1)
+		if (deb_st_play!=1)
+		{
+			deb_timer[DEB_TIMER_START]=0;
+			deb_timer[DEB_TIMER_VIDEO]=0;
+			deb_timer[DEB_TIMER_RIVER]=0;
+			deb_timer[DEB_TIMER_BAR  ]=0;
+		}
+		else
 		{
 
-			if (deb_frame_num<60)
+			if (deb_frame_num==0)
 			{
-				deb_frame_num++;
+				deb_frame_num=1;
+				deb_timer[DEB_TIMER_START]=now+DEB_START_WAIT;
 			}
-			else
-			{
 
+			if ((deb_frame_num<60)&&(deb_timer[DEB_TIMER_START]>0)&&(deb_timer[DEB_TIMER_START]<=now))
+			{
+				deb_frame_num=60;
+				deb_timer[DEB_TIMER_START]=0;
+				deb_timer[DEB_TIMER_VIDEO]=now;
+				deb_timer[DEB_TIMER_RIVER]=now;
+				deb_timer[DEB_TIMER_BAR  ]=now;
+			}
 
-if ((deb_sr_show==1)&&(deb_sr_show_start==1)&&(deb_sr_show_nodisp==0)) deb_sr_river_show(is);  // daipozhi for sound river
+			if (deb_frame_num>=60)
+			{
 
 
+if ((deb_sr_show==1)&&(deb_sr_show_start==1)&&(deb_sr_show_nodisp==0))  // daipozhi for sound river
+{
+	if (deb_timer[DEB_TIMER_RIVER]<=now)
+	{
+		deb_sr_river_show(is);
+		deb_timer[DEB_TIMER_RIVER]=now+REFRESH_RATE;
+	}
+}
+else deb_timer[DEB_TIMER_RIVER]=0;
 
-				if ((deb_thr_v)&&(deb_thr_a)&&(deb_thr_a2)&&(deb_thr_r))
-				{
-					if (is->video_st)
-					{
 
-        if (is->show_mode != SHOW_MODE_NONE && (!is->paused || is->force_refresh))
-            video_refresh(is, &remaining_time);
 
-					}
-				}
+				deb_timer_video(is,now);
 
 
 
-				
-				dpz_modi_ad_cnt++;   //daipozhi modified
-				if (dpz_modi_ad_cnt>=60) 
+				if ((deb_timer[DEB_TIMER_BAR]>0)&&(deb_timer[DEB_TIMER_BAR]<=now))
 				{
-					
-					dpz_modi_ad_cnt=0;
-					
+					deb_timer[DEB_TIMER_BAR]=now+DEB_BAR_WAIT;
+
 					if (is->audio_st && is->show_mode != SHOW_MODE_VIDEO)
 					{
 						if ((deb_thr_a)&&(deb_thr_a2)&&(deb_thr_r))
@@ -4500,7 +6142,7 @@ static char m302_tmp_str1[3000];
 static void event_loop(VideoState *cur_stream)
 {
     SDL_Event event;
-    double incr, pos, frac;
+    double incr, pos;
 
 
 
@@ -4516,7 +6158,6 @@ static void event_loop(VideoState *cur_stream)
 
 
     for (;;) {
-        double x;
         refresh_loop_wait_event(cur_stream, &event);
         switch (event.type) {
         case SDL_KEYDOWN:
@@ -4524,6 +6165,10 @@ static void event_loop(VideoState *cur_stream)
             //    do_exit(cur_stream);
             //    break;
             //}
+            if ((deb_search_on==1)||(event.key.keysym.sym==SDLK_SLASH)) { //daipozhi modified
+                deb_search_key(cur_stream,&event.key.keysym);
+                break;
+            }
             switch (event.key.keysym.sym) {
             case SDLK_ESCAPE:
             case SDLK_q:
@@ -4686,6 +6331,13 @@ static void event_loop(VideoState *cur_stream)
 
 			if ((yy<cur_stream->height-deb_ch_h*2-deb_ch_d)&&(yy>deb_ch_h*2)) // in play list
 			{
+				if (deb_search_on==1)
+				{
+					n1=yy/deb_ch_h;
+					if (n1>=3) deb_search_click(cur_stream,n1-3);
+					break;
+				}
+
 				if ((xx<cur_stream->width-deb_ch_w*2)&&(xx>deb_ch_w*2)) // in file name
 				{
 					if (yy>cur_stream->height-deb_ch_h*3-deb_ch_d) break;
@@ -4710,7 +6362,7 @@ static void event_loop(VideoState *cur_stream)
                         	                        break;
 						}
 
-                                                sc1=deb_getfirstchar(deb_filenamebuff[deb_filenamebuff_n+n2]);
+                                                sc1=deb_getfirstchar(deb_filenamebuff[deb_row(deb_filenamebuff_n+n2)]);
                                                 if (sc1=='|') break; // comment line
                                                 if (sc1==' ') break; // empty line
 						if (sc1!='<') // not dir not empty
@@ -4861,8 +6513,7 @@ static void event_loop(VideoState *cur_stream)
 
                                                             if (deb_cmp_dir(deb_dir_buffer,deb_currentpath)==0)
 							    {
-								  deb_get_dir();
-        	                                                  deb_dir_add_after(deb_filenamebuff_n+n2);
+								  deb_scan_start(deb_filenamebuff_n+n2);
 								  deb_disp_dir(cur_stream);
 							    }
                                                         }
@@ -4936,34 +6587,10 @@ static void event_loop(VideoState *cur_stream)
 				if (deb_st_play==1)
 				{
 
-                x = event.button.x;
+				// video is previewed while the button is down, the seek is at the release
+				if ((event.button.button==SDL_BUTTON_LEFT)&&(deb_scrub_begin(cur_stream,xx)==0)) break;
 
-
-                if (seek_by_bytes || cur_stream->ic->duration <= 0) {
-                    uint64_t size =  avio_size(cur_stream->ic->pb);
-                    stream_seek(cur_stream, size*x/cur_stream->width, 0, 1);
-                } else {
-                    int64_t ts;
-                    int ns, hh, mm, ss;
-                    int tns, thh, tmm, tss;
-                    tns  = cur_stream->ic->duration / 1000000LL;
-                    thh  = tns / 3600;
-                    tmm  = (tns % 3600) / 60;
-                    tss  = (tns % 60);
-                    frac = x / cur_stream->width;
-                    ns   = frac * tns;
-                    hh   = ns / 3600;
-                    mm   = (ns % 3600) / 60;
-                    ss   = (ns % 60);
-                    av_log(NULL, AV_LOG_INFO,
-                           "Seek to %2.0f%% (%2d:%02d:%02d) of total duration (%2d:%02d:%02d)       \n", frac*100,
-                            hh, mm, ss, thh, tmm, tss);
-                    ts = frac * cur_stream->ic->duration;
-                    if (cur_stream->ic->start_time != AV_NOPTS_VALUE)
-                        ts += cur_stream->ic->start_time;
-                    stream_seek(cur_stream, ts, 0, 0);
-                }
-    
+				deb_bar_seek(cur_stream,xx);
 
 				deb_frame_num=0;
 				//deb_disp_bar(cur_stream);
@@ -5081,8 +6708,22 @@ static void event_loop(VideoState *cur_stream)
 				}
 
             }
+            break;
 
-
+        case SDL_MOUSEMOTION: //daipozhi modified for seek bar preview
+            if (!deb_scrub_on)
+                break;
+            if (event.motion.state & SDL_BUTTON_LMASK)
+                deb_scrub_move(cur_stream, event.motion.x);
+            else
+                deb_scrub_end(cur_stream, event.motion.x, 0);   // the release went elsewhere
+            break;
+        case SDL_MOUSEBUTTONUP:
+            if (deb_scrub_on && event.button.button == SDL_BUTTON_LEFT) {
+                deb_scrub_end(cur_stream, event.button.x, 1);
+                deb_frame_num=0;
+            }
+            break;
         /*case SDL_MOUSEMOTION:
             if (cursor_hidden) {
                 SDL_ShowCursor(1);
@@ -5143,6 +6784,7 @@ static void event_loop(VideoState *cur_stream)
 
                 screen = SDL_SetVideoMode(FFMIN(16383, event.resize.w), event.resize.h, 0,
                                           SDL_HWSURFACE|(is_full_screen?SDL_FULLSCREEN:SDL_RESIZABLE)|SDL_ASYNCBLIT|SDL_HWACCEL);
+                deb_disp_dir_valid = 0; //daipozhi modified
                 if (!screen) {
                     av_log(NULL, AV_LOG_FATAL, "Failed to set video mode\n");
                     do_exit(cur_stream);
@@ -5150,6 +6792,7 @@ static void event_loop(VideoState *cur_stream)
                 screen_width  = cur_stream->width  = screen->w;
                 screen_height = cur_stream->height = screen->h;
                 cur_stream->force_refresh = 1;
+                video_lowres_check(cur_stream); //daipozhi modified
 
 
 
@@ -5223,7 +6866,7 @@ static void event_loop(VideoState *cur_stream)
                                                 break;
 					}
 
-                                        sc1=deb_getfirstchar(deb_filenamebuff[deb_filenameplay]);  //daipozhi modified for audio
+                                        sc1=deb_getfirstchar(deb_filenamebuff[deb_row(deb_filenameplay)]);  //daipozhi modified for audio
                                         if (sc1=='|') break; // comment line
                                         if (sc1==' ') break; // empty line
 					if (sc1!='<') // not dir not empty
@@ -5279,6 +6922,25 @@ static void event_loop(VideoState *cur_stream)
         case FF_ALLOC_EVENT:
             alloc_picture(event.user.data1);
             break;
+        case FF_DIR_EVENT:
+            deb_scan_batch(cur_stream);
+            break;
+        case FF_LIB_EVENT:
+            deb_lib_reload();
+            deb_search_lib_new(cur_stream);
+            break;
+        case FF_PROBE_EVENT:
+            deb_probe_batch(cur_stream);
+            break;
+        case FF_GAP_EVENT:
+            deb_gap_next(cur_stream, event.user.code);
+            break;
+        case FF_WAKE_EVENT:
+            deb_wake_event(event.user.code);
+            break;
+        case FF_SCRUB_EVENT:
+            deb_scrub_event(cur_stream);
+            break;
         default:
             break;
         }
@@ -5415,6 +7077,7 @@ static const OptionDef options[] = {
     { "genpts", OPT_BOOL | OPT_EXPERT, { &genpts }, "generate pts", "" },
     { "drp", OPT_INT | HAS_ARG | OPT_EXPERT, { &decoder_reorder_pts }, "let decoder reorder pts 0=off 1=on -1=auto", ""},
     { "lowres", OPT_INT | HAS_ARG | OPT_EXPERT, { &lowres }, "", "" },
+    { "scale_threads", OPT_INT | HAS_ARG | OPT_EXPERT, { &scale_threads }, "threads converting pictures to YUV420P, 0 for one per CPU", "count" },
     { "sync", HAS_ARG | OPT_EXPERT, { .func_arg = opt_sync }, "set audio-video sync. type (type=audio/video/ext)", "type" },
     { "autoexit", OPT_BOOL | OPT_EXPERT, { &autoexit }, "exit at the end", "" },
     { "exitonkeydown", OPT_BOOL | OPT_EXPERT, { &exit_on_keydown }, "exit on key down", "" },
@@ -5436,6 +7099,10 @@ static const OptionDef options[] = {
     { "scodec", HAS_ARG | OPT_STRING | OPT_EXPERT, { &subtitle_codec_name }, "force subtitle decoder", "decoder_name" },
     { "vcodec", HAS_ARG | OPT_STRING | OPT_EXPERT, {    &video_codec_name }, "force video decoder",    "decoder_name" },
     { "autorotate", OPT_BOOL, { &autorotate }, "automatically rotate video", "" },
+    { "autolowres", OPT_BOOL | OPT_EXPERT, { &auto_lowres }, "decode video at a lower resolution when it is shown much smaller, unless -lowres is given", "" },
+    { "hiddenkey", OPT_BOOL | OPT_EXPERT, { &hidden_keyframes }, "decode only keyframes while the video is covered by the file list", "" },
+    { "dr", OPT_BOOL | OPT_EXPERT, { &direct_render }, "show decoded frames without copying them when the overlay allows it", "" },
+    { "accurate", OPT_BOOL | OPT_EXPERT, { &accurate_seek }, "after a seek show the first frame at the target, not the keyframe before it", "" },
     { NULL, },
 };
 
@@ -5622,6 +7289,8 @@ int main(void /*int argc, char **argv*/)
     SDL_EventState(SDL_ACTIVEEVENT, SDL_IGNORE);
     SDL_EventState(SDL_SYSWMEVENT, SDL_IGNORE);
     SDL_EventState(SDL_USEREVENT, SDL_IGNORE);
+    deb_wake_init(); //daipozhi modified
+    SDL_EnableUNICODE(1); //daipozhi modified
 
     SDL_EnableKeyRepeat(SDL_DEFAULT_REPEAT_DELAY, SDL_DEFAULT_REPEAT_INTERVAL);
 
@@ -5633,6 +7302,9 @@ int main(void /*int argc, char **argv*/)
     av_init_packet(&flush_pkt);
     flush_pkt.data = (uint8_t *)&flush_pkt;
 
+    av_init_packet(&deb_gap_pkt);  //daipozhi modified for gapless
+    deb_gap_pkt.data = (uint8_t *)&deb_gap_pkt;
+
 
 
 
@@ -5659,6 +7331,10 @@ int main(void /*int argc, char **argv*/)
 		   //*****notice
 
     deb_get_dir_ini();  //daipozhi modified  
+    deb_scan_init();    //daipozhi modified  
+    deb_dcache_init();  //daipozhi modified  
+    deb_lib_init();     //daipozhi modified  
+    deb_probe_init();   //daipozhi modified  
 
     deb_disp_dir(is);
     deb_disp_bar(is);
@@ -6155,6 +7831,158 @@ static int deb_echo_char4chsblack(int x,int y,int k,int l)
 }
 
 
+// daipozhi modified for tree
+// slot of display row pp, -1 if there is no such row
+static int deb_row(int pp)
+{
+	if (pp<0) return(-1);
+	if (pp>=deb_filenamecnt) return(-1);
+
+	if (pp<deb_filenamerow_gap) return(deb_filenamerow[pp]);
+	else return(deb_filenamerow[pp+10000-deb_filenamecnt]);
+}
+
+static int deb_row_ini(void)
+{
+	int i;
+
+	deb_filenamecnt=0;
+	deb_filenamerow_gap=0;
+
+	for (i=0;i<10000;i++)
+	{
+		deb_filenamerow[i]=0;
+		deb_filenamerow_free[i]=10000-1-i;
+	}
+
+	deb_filenamerow_freecnt=10000;
+
+	return(0);
+}
+
+static int deb_row_gap_move(int pp)
+{
+	int gl;
+
+	if (pp<0) return(0);
+	if (pp>deb_filenamecnt) return(0);
+
+	gl=10000-deb_filenamecnt;
+
+	if (pp<deb_filenamerow_gap)
+	{
+		memmove(&deb_filenamerow[pp+gl],&deb_filenamerow[pp],
+			(deb_filenamerow_gap-pp)*sizeof(int));
+	}
+	else if (pp>deb_filenamerow_gap)
+	{
+		memmove(&deb_filenamerow[deb_filenamerow_gap],&deb_filenamerow[deb_filenamerow_gap+gl],
+			(pp-deb_filenamerow_gap)*sizeof(int));
+	}
+
+	deb_filenamerow_gap=pp;
+
+	return(0);
+}
+
+// insert an empty row before display row pp, return its slot
+static int deb_row_insert(int pp)
+{
+	int i;
+
+	if (pp<0) return(-1);
+	if (pp>deb_filenamecnt) return(-1);
+	if (deb_filenamecnt>=10000) return(-1);
+	if (deb_filenamerow_freecnt<=0) return(-1);
+
+	deb_row_gap_move(pp);
+
+	deb_filenamerow_freecnt--;
+	i=deb_filenamerow_free[deb_filenamerow_freecnt];
+
+	deb_filenamerow[deb_filenamerow_gap]=i;
+	deb_filenamerow_gap++;
+	deb_filenamecnt++;
+
+	deb_filenamebuff[i][0]=0;
+	deb_filenamebuffpp[i]=0;
+	deb_filenamebuff_ext[i][0]=0;
+	deb_filenamebuff_size[i][0]=0;
+	deb_filenamebuff_date[i][0]=0;
+	deb_filenamebuff_len[i]=0;
+	deb_filenamebuff_type[i]=0;
+
+	deb_filenamebuff_parent[i]=(-1);
+	deb_filenamebuff_name[i]=0;
+	deb_filenamebuff_namelen[i]=0;
+
+	deb_filenamebuff_dur[i][0]=0;
+	deb_filenamebuff_probe[i]=0;
+	deb_filenamebuff_stamp[i]++;
+
+	return(i);
+}
+
+// set parent and name span of slot i, after deb_filenamebuff[i] is filled
+static int deb_row_set_name(int i,int parent)
+{
+	int j,k;
+
+	deb_filenamebuff_parent[i]=parent;
+
+	j=0;
+	while ((j<1000-1)&&(deb_filenamebuff[i][j]==' ')) j++;
+
+	if (deb_filenamebuff[i][j]=='<')
+	{
+		j++;
+		while ((j<1000-1)&&(deb_filenamebuff[i][j]==' ')) j++;
+	}
+
+	k=(int)strlen(deb_filenamebuff[i]);
+
+	while ((k>j)&&(deb_filenamebuff[i][k-1]==' ')) k--;
+
+	if ((k>j)&&(deb_filenamebuff[i][k-1]=='>')) k--;
+	else k=(int)strlen(deb_filenamebuff[i]);
+
+	deb_filenamebuff_name[i]=(short)j;
+	deb_filenamebuff_namelen[i]=(short)(k-j);
+
+	return(0);
+}
+
+static int deb_row_delete(int pp)
+{
+	int i;
+
+	if (pp<0) return(0);
+	if (pp>=deb_filenamecnt) return(0);
+
+	deb_row_gap_move(pp+1);
+
+	deb_filenamerow_gap--;
+	deb_filenamecnt--;
+
+	i=deb_filenamerow[deb_filenamerow_gap];
+
+	if (i==deb_scan_slot) deb_scan_cancel();
+
+	deb_filenamebuff[i][0]=0;
+	deb_filenamebuff_dur[i][0]=0;
+	deb_filenamebuff_probe[i]=0;
+	deb_filenamebuff_ext[i][0]=0;
+	deb_filenamebuff_size[i][0]=0;
+	deb_filenamebuff_date[i][0]=0;
+	deb_filenamebuff_len[i]=0;
+	deb_filenamebuff_type[i]=0;
+
+	deb_filenamerow_free[deb_filenamerow_freecnt]=i;
+	deb_filenamerow_freecnt++;
+
+	return(0);
+}
+
 // daipozhi modified 
 static int deb_get_dir_ini(void)
 {
@@ -6165,69 +7993,92 @@ static int deb_get_dir_ini(void)
 
 	for (i=0;i<10000;i++) deb_filenamebuff[i][0]=0;
 
+	deb_row_ini();
+
 	getcwd(deb_currentpath,1000);
 	deb_filenamebuff_n=0;
 	deb_filenameplay=0;
-	deb_filenamecnt=0;
 /*
     strcpy(deb_filenamebuff[0],"</>");
     deb_filenamecnt++;
 */
 
 
-	strcpy(deb_filenamebuff[deb_filenamecnt],"</>");
-	deb_filenamebuffpp[deb_filenamecnt]=2;
-	deb_filenamecnt++;
+	i=deb_row_insert(deb_filenamecnt);
+	if (i<0) return(0);
+	strcpy(deb_filenamebuff[i],"</>");
+	deb_filenamebuffpp[i]=2;
+	deb_row_set_name(i,-1);
 	if (deb_filenamecnt>=3000) return(0);
 
-	strcpy(deb_filenamebuff[deb_filenamecnt],"<C:/>");
-	deb_filenamebuffpp[deb_filenamecnt]=2;
-	deb_filenamecnt++;
+	i=deb_row_insert(deb_filenamecnt);
+	if (i<0) return(0);
+	strcpy(deb_filenamebuff[i],"<C:/>");
+	deb_filenamebuffpp[i]=2;
+	deb_row_set_name(i,-1);
 	if (deb_filenamecnt>=3000) return(0);
 
-	strcpy(deb_filenamebuff[deb_filenamecnt],"<D:/>");
-	deb_filenamebuffpp[deb_filenamecnt]=2;
-	deb_filenamecnt++;
+	i=deb_row_insert(deb_filenamecnt);
+	if (i<0) return(0);
+	strcpy(deb_filenamebuff[i],"<D:/>");
+	deb_filenamebuffpp[i]=2;
+	deb_row_set_name(i,-1);
 	if (deb_filenamecnt>=3000) return(0);
 
-	strcpy(deb_filenamebuff[deb_filenamecnt],"<E:/>");
-	deb_filenamebuffpp[deb_filenamecnt]=2;
-	deb_filenamecnt++;
+	i=deb_row_insert(deb_filenamecnt);
+	if (i<0) return(0);
+	strcpy(deb_filenamebuff[i],"<E:/>");
+	deb_filenamebuffpp[i]=2;
+	deb_row_set_name(i,-1);
 	if (deb_filenamecnt>=3000) return(0);
 
-	strcpy(deb_filenamebuff[deb_filenamecnt],"<F:/>");
-	deb_filenamebuffpp[deb_filenamecnt]=2;
-	deb_filenamecnt++;
+	i=deb_row_insert(deb_filenamecnt);
+	if (i<0) return(0);
+	strcpy(deb_filenamebuff[i],"<F:/>");
+	deb_filenamebuffpp[i]=2;
+	deb_row_set_name(i,-1);
 	if (deb_filenamecnt>=3000) return(0);
 
-	strcpy(deb_filenamebuff[deb_filenamecnt],"<G:/>");
-	deb_filenamebuffpp[deb_filenamecnt]=2;
-	deb_filenamecnt++;
+	i=deb_row_insert(deb_filenamecnt);
+	if (i<0) return(0);
+	strcpy(deb_filenamebuff[i],"<G:/>");
+	deb_filenamebuffpp[i]=2;
+	deb_row_set_name(i,-1);
 	if (deb_filenamecnt>=3000) return(0);
 
-	strcpy(deb_filenamebuff[deb_filenamecnt],"<H:/>");
-	deb_filenamebuffpp[deb_filenamecnt]=2;
-	deb_filenamecnt++;
+	i=deb_row_insert(deb_filenamecnt);
+	if (i<0) return(0);
+	strcpy(deb_filenamebuff[i],"<H:/>");
+	deb_filenamebuffpp[i]=2;
+	deb_row_set_name(i,-1);
 	if (deb_filenamecnt>=3000) return(0);
 
-	strcpy(deb_filenamebuff[deb_filenamecnt],"<I:/>");
-	deb_filenamebuffpp[deb_filenamecnt]=2;
-	deb_filenamecnt++;
+	i=deb_row_insert(deb_filenamecnt);
+	if (i<0) return(0);
+	strcpy(deb_filenamebuff[i],"<I:/>");
+	deb_filenamebuffpp[i]=2;
+	deb_row_set_name(i,-1);
 	if (deb_filenamecnt>=3000) return(0);
 
-	strcpy(deb_filenamebuff[deb_filenamecnt],"<J:/>");
-	deb_filenamebuffpp[deb_filenamecnt]=2;
-	deb_filenamecnt++;
+	i=deb_row_insert(deb_filenamecnt);
+	if (i<0) return(0);
+	strcpy(deb_filenamebuff[i],"<J:/>");
+	deb_filenamebuffpp[i]=2;
+	deb_row_set_name(i,-1);
 	if (deb_filenamecnt>=3000) return(0);
 
-	strcpy(deb_filenamebuff[deb_filenamecnt],"<K:/>");
-	deb_filenamebuffpp[deb_filenamecnt]=2;
-	deb_filenamecnt++;
+	i=deb_row_insert(deb_filenamecnt);
+	if (i<0) return(0);
+	strcpy(deb_filenamebuff[i],"<K:/>");
+	deb_filenamebuffpp[i]=2;
+	deb_row_set_name(i,-1);
 	if (deb_filenamecnt>=3000) return(0);
 
-	strcpy(deb_filenamebuff[deb_filenamecnt],"<L:/>");
-	deb_filenamebuffpp[deb_filenamecnt]=2;
-	deb_filenamecnt++;
+	i=deb_row_insert(deb_filenamecnt);
+	if (i<0) return(0);
+	strcpy(deb_filenamebuff[i],"<L:/>");
+	deb_filenamebuffpp[i]=2;
+	deb_row_set_name(i,-1);
 	if (deb_filenamecnt>=3000) return(0);
 
 /*
@@ -6325,12 +8176,12 @@ static int deb_dir_opened(int pp )
   if (pp>=10000) return(0);
   if (pp>=deb_filenamecnt) return(0);
 
-  i=deb_get_space(deb_filenamebuff[pp]);
+  i=deb_get_space(deb_filenamebuff[deb_row(pp)]);
 
   if (pp+1>=deb_filenamecnt) return(0);
   else
   {
-    j=deb_get_space(deb_filenamebuff[pp+1]);
+    j=deb_get_space(deb_filenamebuff[deb_row(pp+1)]);
     if (j>i) return(1);
     else return(0);
   }
@@ -6391,7 +8242,7 @@ static char m101_s2[100];
 
 static int deb_dir_add_after(int pp)
 {
-  int i,j,k/*,l*/;
+  int i,j,k,n;
   //char s1[3000];
   //char s2[100];
 
@@ -6403,7 +8254,7 @@ static int deb_dir_add_after(int pp)
   {
     m101_s1[0]=0;
 
-    j=deb_get_space(deb_filenamebuff[pp]);
+    j=deb_get_space(deb_filenamebuff[deb_row(pp)]);
     for (k=0;k<j;k++)
     {
       m101_s1[k+0]=' ';
@@ -6412,82 +8263,51 @@ static int deb_dir_add_after(int pp)
 
     strcpy(m101_s2,"  ");
 
-    for (i=deb_filenamecnt-1;i>pp;i--)
-    {
-	  if (i<0) continue;
-	  if (i>=10000) continue;
-
-	  if (i+deb_filenamecnt2<0) continue;
-	  if (i+deb_filenamecnt2>=10000) continue;
-
-	  if (deb_str_has_null(deb_filenamebuff[i],1000)!=1) continue;
-
-	  if (strlen(deb_filenamebuff[i])>=1000) continue;
-
-      	strcpy(deb_filenamebuff[i+deb_filenamecnt2],deb_filenamebuff[i]);
-
-      	strcpy(deb_filenamebuff_ext[i+deb_filenamecnt2],deb_filenamebuff_ext[i]);
-      	strcpy(deb_filenamebuff_size[i+deb_filenamecnt2],deb_filenamebuff_size[i]);
-      	strcpy(deb_filenamebuff_date[i+deb_filenamecnt2],deb_filenamebuff_date[i]);
-
-	deb_filenamebuff_len[i+deb_filenamecnt2]=deb_filenamebuff_len[i];
-	deb_filenamebuff_type[i+deb_filenamecnt2]=deb_filenamebuff_type[i];
-
-      	deb_filenamebuff[i][0]=0;
-
-	deb_filenamebuff_ext[i][0]=0;
-	deb_filenamebuff_size[i][0]=0;
-	deb_filenamebuff_date[i][0]=0;
-
-	deb_filenamebuff_len[i]=0;
-	deb_filenamebuff_type[i]=0;
-
-    }
+    n=0;
 
     for (i=0;i<=deb_filenamecnt2-1;i++)
     {
 	  if (i<0) continue;
-	  if (i>=10000) continue;
+	  if (i>=3000) continue;
 
-	  if (pp+1+i<0) continue;
-	  if (pp+1+i>=10000) continue;
-
-	  if (deb_str_has_null(deb_filenamebuff[i],1000)!=1) continue;
+	  if (deb_str_has_null(deb_filenamebuff2[i],1000)!=1) continue;
 	  if (deb_str_has_null(m101_s1,3000)!=1) continue;
 	  if (deb_str_has_null(m101_s2,100)!=1) continue;
 
-	  if (strlen(deb_filenamebuff[i])+strlen(m101_s1)+strlen(m101_s2)>=1000) continue;
+	  if (strlen(deb_filenamebuff2[i])+strlen(m101_s1)+strlen(m101_s2)>=1000) continue;
+
+	  k=deb_row_insert(pp+1+n);
+	  if (k<0) break;
 
-      	strcpy(deb_filenamebuff[pp+1+i],m101_s1);
-      	strcat(deb_filenamebuff[pp+1+i],m101_s2);
-      	strcat(deb_filenamebuff[pp+1+i],deb_filenamebuff2[i]);
+      	strcpy(deb_filenamebuff[k],m101_s1);
+      	strcat(deb_filenamebuff[k],m101_s2);
+      	strcat(deb_filenamebuff[k],deb_filenamebuff2[i]);
 
-      	strcpy(deb_filenamebuff_ext[pp+1+i],deb_filenamebuff2_ext[i]);
-      	strcpy(deb_filenamebuff_size[pp+1+i],deb_filenamebuff2_size[i]);
-      	strcpy(deb_filenamebuff_date[pp+1+i],deb_filenamebuff2_date[i]);
+      	strcpy(deb_filenamebuff_ext[k],deb_filenamebuff2_ext[i]);
+      	strcpy(deb_filenamebuff_size[k],deb_filenamebuff2_size[i]);
+      	strcpy(deb_filenamebuff_date[k],deb_filenamebuff2_date[i]);
 
-	deb_filenamebuff_len[pp+1+i]=0;
-	deb_filenamebuff_type[pp+1+i]=0;
+	deb_row_set_name(k,deb_row(pp));
+
+	n++;
     }
     
-    deb_filenamecnt=deb_filenamecnt+deb_filenamecnt2;
-
-    deb_filenamebuff_len[pp] =deb_m_info_len;
-    deb_filenamebuff_type[pp]=deb_m_info_type;
+    deb_filenamebuff_len[deb_row(pp)] =deb_m_info_len;
+    deb_filenamebuff_type[deb_row(pp)]=deb_m_info_type;
 
     if (pp>=deb_filenameplay)
     {
     }
     else
     {
-      deb_filenameplay=deb_filenameplay+deb_filenamecnt2;
+      deb_filenameplay=deb_filenameplay+n;
     }
   }
   else
   {
     m101_s1[0]=0;
 
-    j=deb_get_space(deb_filenamebuff[pp]);
+    j=deb_get_space(deb_filenamebuff[deb_row(pp)]);
     for (k=0;k<j;k++)
     {
       m101_s1[k+0]=' ';
@@ -6496,49 +8316,21 @@ static int deb_dir_add_after(int pp)
 
     strcpy(m101_s2,"  ");
 
-    for (i=deb_filenamecnt-1;i>pp;i--)
-    {
-	  if (i<0) continue;
-	  if (i>=10000) continue;
-
-	  if (i+1<0) continue;
-	  if (i+1>=10000) continue;
-
-	  if (deb_str_has_null(deb_filenamebuff[i],1000)!=1) continue;
-
-	  if (strlen(deb_filenamebuff[i])>=1000) continue;
-
-      	strcpy(deb_filenamebuff[i+1],deb_filenamebuff[i]);
-
-      	deb_filenamebuff[i][0]=0;
-
-      	strcpy(deb_filenamebuff_ext[i+1],deb_filenamebuff_ext[i]);
-      	strcpy(deb_filenamebuff_size[i+1],deb_filenamebuff_size[i]);
-      	strcpy(deb_filenamebuff_date[i+1],deb_filenamebuff_date[i]);
-
-	deb_filenamebuff_ext[i][0]=0;
-	deb_filenamebuff_size[i][0]=0;
-	deb_filenamebuff_date[i][0]=0;
-
-	deb_filenamebuff_len[i+1] =deb_filenamebuff_len[i];
-	deb_filenamebuff_type[i+1]=deb_filenamebuff_type[i];
+    k=deb_row_insert(pp+1);
+    if (k<0) return(0);
 
-	deb_filenamebuff_len[i]=0;
-	deb_filenamebuff_type[i]=0;
-    }
+    strcpy(deb_filenamebuff[k],m101_s1);
+    strcat(deb_filenamebuff[k],m101_s2);
+    strcat(deb_filenamebuff[k],"|Empty Fold|");
 
-    strcpy(deb_filenamebuff[pp+1],m101_s1);
-    strcat(deb_filenamebuff[pp+1],m101_s2);
-    strcat(deb_filenamebuff[pp+1],"|Empty Fold|");
+    strcpy(deb_filenamebuff_ext[k],"    ");
+    strcpy(deb_filenamebuff_size[k],"      ");
+    strcpy(deb_filenamebuff_date[k],"                   ");
 
-    strcpy(deb_filenamebuff_ext[pp+1],"    ");
-    strcpy(deb_filenamebuff_size[pp+1],"      ");
-    strcpy(deb_filenamebuff_date[pp+1],"                   ");
+    deb_row_set_name(k,deb_row(pp));
     
-    deb_filenamecnt=deb_filenamecnt+1;
-
-    deb_filenamebuff_len[pp] =12;
-    deb_filenamebuff_type[pp]=0;
+    deb_filenamebuff_len[deb_row(pp)] =12;
+    deb_filenamebuff_type[deb_row(pp)]=0;
 
     if (pp>=deb_filenameplay)
     {
@@ -6561,16 +8353,19 @@ static int deb_dir_remove_after(int pp)
   if (pp>=10000) return(0);
   if (pp>=deb_filenamecnt) return(0);
 
-  i=deb_get_space(deb_filenamebuff[pp]);
+  if (deb_row(pp)==deb_scan_slot) deb_scan_cancel();
+
+  i=deb_get_space(deb_filenamebuff[deb_row(pp)]);
 
   k=0;
+  p1=deb_filenamecnt;
 
   for (j=pp+1;j<deb_filenamecnt;j++)
   {
 		if (j<0) continue;
 		if (j>=10000) continue;
 
-    l=deb_get_space(deb_filenamebuff[j]);
+    l=deb_get_space(deb_filenamebuff[deb_row(j)]);
     if (l<=i)
     {
       k=1;
@@ -6579,79 +8374,15 @@ static int deb_dir_remove_after(int pp)
     }
   }
 
+  // delete from the end, so the gap stays where it is
+  for (j=p1-1;j>pp;j--) deb_row_delete(j);
+
   if (k==0)
   {
-
-    for (j=pp+1;j<deb_filenamecnt;j++)
-    {
-		if (j<0) continue;
-		if (j>=10000) continue;
-
-      deb_filenamebuff[j][0]=0;
-
-      deb_filenamebuff_ext[j][0]=0;
-      deb_filenamebuff_size[j][0]=0;
-      deb_filenamebuff_date[j][0]=0;
-
-      deb_filenamebuff_len[j]=0;
-      deb_filenamebuff_type[j]=0;
-    }
-
-    deb_filenamecnt=pp+1;
-
     deb_filenameplay=pp;
-
   }
   else
   {
-    for (j=p1;j<deb_filenamecnt;j++)
-    {
-		if (j<0) continue;
-		if (j>=10000) continue;
-
-		if (pp+1+j-p1<0) continue;
-		if (pp+1+j-p1>=10000) continue;
-
-		if (deb_str_has_null(deb_filenamebuff[j],1000)!=1) continue;
-
-		if (strlen(deb_filenamebuff[j])>=1000) continue;
-
-      strcpy(deb_filenamebuff[pp+1+j-p1],deb_filenamebuff[j]);
-
-      deb_filenamebuff[j][0]=0;
-
-      strcpy(deb_filenamebuff_ext[pp+1+j-p1],deb_filenamebuff_ext[j]);
-      strcpy(deb_filenamebuff_size[pp+1+j-p1],deb_filenamebuff_size[j]);
-      strcpy(deb_filenamebuff_date[pp+1+j-p1],deb_filenamebuff_date[j]);
-
-      deb_filenamebuff_ext[j][0]=0;
-      deb_filenamebuff_size[j][0]=0;
-      deb_filenamebuff_date[j][0]=0;
-
-      deb_filenamebuff_len[pp+1+j-p1] =deb_filenamebuff_len[j];
-      deb_filenamebuff_type[pp+1+j-p1]=deb_filenamebuff_type[j];
-
-      deb_filenamebuff_len[j]=0;
-      deb_filenamebuff_type[j]=0;
-    }
-
-    for (j=pp+deb_filenamecnt-p1+1;j<p1;j++)
-    {
-		if (j<0) continue;
-		if (j>=10000) continue;
-
-		deb_filenamebuff[j][0]=0;
-
-		deb_filenamebuff_ext[j][0]=0;
-		deb_filenamebuff_size[j][0]=0;
-		deb_filenamebuff_date[j][0]=0;
-
-		deb_filenamebuff_len[j]=0;
-		deb_filenamebuff_type[j]=0;
-    }
-
-    deb_filenamecnt=deb_filenamecnt-(p1-pp-1);
-
     if ((pp>=deb_filenameplay)&&(p1>=deb_filenameplay))
     {
     }
@@ -6671,270 +8402,89 @@ static int deb_dir_remove_after(int pp)
   return(0);
 }
 
-static char m5_buffer1[3000];
-static char m5_buffer2[3000];
-static char m5_buffer3[3000];
-static char m5_buffer4[3000];
-
 static int deb_get_path(int pp)
 {
-	//char buffer1[3000];
-	//char buffer2[3000];
-	//char buffer3[3000];
-	//char buffer4[3000];
-	int  ns1,ns2;
-    	int  p1;
+	return(deb_get_path_to(pp,deb_dir_buffer));
+}
+
+static int deb_get_path_to(int pp,char *deb_dir_buffer)
+{
+	deb_dir_buffer[0]=0;
 
   	if (pp<0) return(0);
   	if (pp>=10000) return(0);
   	if (pp>=deb_filenamecnt) return(0);
 
-    	p1=pp;
+	return(deb_get_slot_path(deb_row(pp),deb_dir_buffer));
+}
 
-    	m5_buffer4[0]=0;
+// walk up the parent slots, fill deb_dir_buffer from the end
+static int deb_get_slot_path(int slot,char *deb_dir_buffer)
+{
+	int  i,n,p1,p2;
 
 	deb_dir_buffer[0]=0;
 
-	ns1=deb_get_space(deb_filenamebuff[pp]);
+  	if (slot<0) return(0);
+  	if (slot>=10000) return(0);
+
+	n=0;
+	p2=0;
+	p1=slot;
 
 	while (p1>=0)
 	{
+		n=n+deb_filenamebuff_namelen[p1];
 
-		if (ns1<2)
-		{
-			strcpy(m5_buffer1,deb_filenamebuff[p1]);
-
-			deb_get_path2(m5_buffer1,m5_buffer2);
-			//strcpy(deb_dir_buffer,"/");
-			//return(0);
-			strcpy(m5_buffer3,m5_buffer2);
-		}
-		else
-		{
-			if (ns1<4)
-			{
-
-				strcpy(m5_buffer1,deb_filenamebuff[p1]);
+		// below the second level names are joined with '/'
+		if ((deb_filenamebuff_parent[p1]>=0)&&(deb_filenamebuff_parent[deb_filenamebuff_parent[p1]]>=0)) n++;
 
-				deb_get_path2(m5_buffer1,m5_buffer2);
-				strcpy(m5_buffer3,m5_buffer2);
+		p1=deb_filenamebuff_parent[p1];
 
-			}
-			else
-			{
+		p2++;
+		if (p2>=10000) return(0);
+	}
 
-				strcpy(m5_buffer1,deb_filenamebuff[p1]);
-	
-				deb_get_path1(m5_buffer1,m5_buffer2);
-				strcpy(m5_buffer3,m5_buffer2);
+	if (n>=3000) return(0);
 
-			}
-		}
+	deb_dir_buffer[n]=0;
 
-		strcat(m5_buffer3,m5_buffer4);
+	p1=slot;
 
-		strcpy(m5_buffer4,m5_buffer3);
+	while (p1>=0)
+	{
+		i=deb_filenamebuff_namelen[p1];
+		n=n-i;
 
+		memcpy(deb_dir_buffer+n,deb_filenamebuff[p1]+deb_filenamebuff_name[p1],i);
 
-		while(1)
+		if ((deb_filenamebuff_parent[p1]>=0)&&(deb_filenamebuff_parent[deb_filenamebuff_parent[p1]]>=0))
 		{
-			p1--;
-
-			if (p1<0) break;
-
-			strcpy(m5_buffer1,deb_filenamebuff[p1]);
-
-			ns2=deb_get_space(m5_buffer1);
-	
-			if (ns2>=ns1) continue;
-			else
-			{
-				ns1=ns2;
-                                break;
-			}
+			n--;
+			deb_dir_buffer[n]='/';
 		}
 
+		p1=deb_filenamebuff_parent[p1];
 	}
 
-	strcpy(deb_dir_buffer,m5_buffer4);
 	return(0);
-
-
 }
 
-static char m102_buffer3[3000];
-static char m102_buffer4[3000];
 
+//static char m104_str1[3000];
 
-static int deb_get_path1(char *buffer1,char *buffer2)
+static int deb_filenameext(char *name,char *fext)
 {
-	int  i,j,k/*,n*/;
-	//char buffer3[3000];
-	//char buffer4[3000];
+	//char str1[3000];
+	int  i,j,k,l;
+	//struct stat info;
 
-	strcpy(m102_buffer3,buffer1);
-	strcpy(m102_buffer4,"");
+	i=(int)strlen(name);
+	k=(-1);
 
-	for (i=0;i<(int)strlen(m102_buffer3);i++)
+	for (j=i-1;j>=0;j--)
 	{
-		if (m102_buffer3[i]==' ') continue;
-		else
-		{
-			if (m102_buffer3[i]=='<')
-			{
-				m102_buffer3[i]=' ';
-				break;
-			}
-			else break;
-		}
-	}
-
-	for (i=(int)strlen(m102_buffer3)-1;i>=0;i--)
-	{
-		if ((m102_buffer3[i]==' ')||(m102_buffer3[i]==0)) continue;
-		else
-		{
-			if (m102_buffer3[i]=='>')
-			{
-				m102_buffer3[i]=0;
-				break;
-			}
-			else break;
-		}
-	}
-
-	j=0;
-	k=0;
-
-	for (i=0;i<(int)strlen(m102_buffer3);i++)
-	{
-		if (m102_buffer3[i]==' ')
-		{
-			if (k==0)
-			{
-				continue;
-			}
-			else
-			{
-				m102_buffer4[j+0]=m102_buffer3[i];
-				m102_buffer4[j+1]=0;
-
-				j++;
-			}
-		}
-		else
-		{
-			k=1;
-
-			m102_buffer4[j+0]=m102_buffer3[i];
-			m102_buffer4[j+1]=0;
-
-			j++;
-		}
-	}
-
-	//strcat(buffer4,"\\");
-
-    	strcpy(buffer2,"/");
-	strcat(buffer2,m102_buffer4);
-
-	return(0);
-}
-
-static char m103_buffer3[3000];
-static char m103_buffer4[3000];
-
-
-static int deb_get_path2(char *buffer1,char *buffer2)
-{
-	int  i,j,k;
-	//char buffer3[3000];
-	//char buffer4[3000];
-
-	strcpy(m103_buffer3,buffer1);
-	strcpy(m102_buffer4,"");
-
-	for (i=0;i<(int)strlen(m103_buffer3);i++)
-	{
-		if (m103_buffer3[i]==' ') continue;
-		else
-		{
-			if (m103_buffer3[i]=='<')
-			{
-				m103_buffer3[i]=' ';
-				break;
-			}
-			else break;
-		}
-	}
-
-	for (i=(int)strlen(m103_buffer3)-1;i>=0;i--)
-	{
-		if ((m103_buffer3[i]==' ')||(m103_buffer3[i]==0)) continue;
-		else
-		{
-			if (m103_buffer3[i]=='>')
-			{
-				m103_buffer3[i]=0;
-				break;
-			}
-			else break;
-		}
-	}
-
-	j=0;
-	k=0;
-
-	for (i=0;i<(int)strlen(m103_buffer3);i++)
-	{
-		if (m103_buffer3[i]==' ')
-		{
-			if (k==0) // 
-			{
-				continue;
-			}
-			else
-			{
-				m103_buffer4[j+0]=m103_buffer3[i];
-				m103_buffer4[j+1]=0;
-
-				j++;
-			}
-		}
-		else
-		{
-			k=1;
-
-			m103_buffer4[j+0]=m103_buffer3[i];
-			m103_buffer4[j+1]=0;
-
-			j++;
-		}
-	}
-
-	//strcat(buffer4,"\\");
-
-
-	strcpy(buffer2,m103_buffer4);
-
-	return(0);
-}
-
-
-//static char m104_str1[3000];
-
-static int deb_filenameext(char *name,char *fext)
-{
-	//char str1[3000];
-	int  i,j,k,l;
-	//struct stat info;
-
-	i=(int)strlen(name);
-	k=(-1);
-
-	for (j=i-1;j>=0;j--)
-	{
-		if (name[j]=='.')
+		if (name[j]=='.')
 		{
 			k=j;
 			break;
@@ -7080,22 +8630,28 @@ static int deb_cmp_dir(char *buffer1,char *buffer2)
 
 static char m105_str1[3000];
 
-static int deb_filename_dir(char *path,char *name)
+// 1 if the entry is a folder, d_type first, stat only when it is unknown or a link
+static int deb_filename_dir(char *path,int dfd,struct dirent *entry)
 {
 	//char str1[3000];
-	//struct stat info;
+	struct stat info;
+
+#ifdef DT_DIR
+	if (entry->d_type==DT_DIR) return(1);
+	if (entry->d_type==DT_REG) return(0);
+#endif
 
+#if !defined(_WIN32)
+	if (fstatat(dfd,entry->d_name,&info,0)!=0) return(0);
+#else
 	strcpy(m105_str1,path);
 	av_strlcat(m105_str1,"/" ,3000);
-	av_strlcat(m105_str1,name,3000);
+	av_strlcat(m105_str1,entry->d_name,3000);
 
-#if !defined(_WIN32) && !defined(__APPLE__)
-	stat64(m105_str1,&deb_m_info);
-#else
-	stat(m105_str1,&deb_m_info);
+	if (stat(m105_str1,&info)!=0) return(0);
 #endif
 
-	if (S_ISDIR(deb_m_info.st_mode)) return(1);
+	if (S_ISDIR(info.st_mode)) return(1);
 	else return(0);
 }
 
@@ -7119,6 +8675,16 @@ static int deb_utf8_to_gb18030(char *inbuffer,char *outbuffer,int outbufferlen)
 
 
 static char disp_buff[1000][2000];
+
+	// what is on the screen now, line by line, so only changed lines are drawn
+static char disp_buff_old[1000][2000];
+static char disp_buff_old_black[1000];
+static char disp_buff_old_ok[1000];
+static int  disp_old_n;
+static int  disp_old_h;
+static int  disp_old_w;
+static int  disp_old_width;
+
 static char m11_str1[3000];
 static char m11_str2[3000];
 static char m11_str3[3000];
@@ -7139,12 +8705,11 @@ static int deb_disp_dir(VideoState *cur_stream)
 	char c1,c2,c3;
 	char *strpp;
 	int  bgcolor;
+	int  y1,y2;
+	SDL_Rect rect1,rect2;
 
 	start=(-1);
 
-	for (n1=0;n1<1000;n1++)
-		for (n2=0;n2<2000;n2++) disp_buff[n1][n2]=0;
-
 	h = (cur_stream->height /deb_ch_h)-2;
 	w = cur_stream->width /deb_ch_w ;
 
@@ -7156,17 +8721,16 @@ static int deb_disp_dir(VideoState *cur_stream)
 
 	deb_ch_m = w;
 
-	for (n1=0;n1<h;n1++)
-	{
-		if (n1>=1000) continue;
-
-		for (n2=0;n2<w;n2++)
-		{
-			if (n2>=2000-1) continue;
+	// only the lines and columns on the screen are cleared
+	n3=h;
+	if (n3>1000) n3=1000;
+	n4=w;
+	if (n4>2000-1) n4=2000-1;
 
-			disp_buff[n1][n2+0]=' ';
-			disp_buff[n1][n2+1]=0;
-		}
+	for (n1=0;n1<n3;n1++)
+	{
+		memset(disp_buff[n1],' ',n4);
+		disp_buff[n1][n4]=0;
 	}
 
 	for (n1=0;n1<w;n1=n1+2) 
@@ -7251,6 +8815,12 @@ static int deb_disp_dir(VideoState *cur_stream)
 	}
 
 
+	if (deb_search_on==1)
+	{
+		deb_search_fill(h,w);
+		goto disp_draw;
+	}
+
 	if (deb_str_has_null(deb_currentpath,3000)!=1) return(0);
 
 	strcpy(m11_str1,deb_currentpath);
@@ -7327,11 +8897,11 @@ static int deb_disp_dir(VideoState *cur_stream)
 		if (deb_filenamebuff_n+n4>=10000) continue;
 		if (deb_filenamebuff_n+n4>=deb_filenamecnt) continue;
 
-		if (deb_str_has_null(deb_filenamebuff[deb_filenamebuff_n+n4],1000)!=1) continue;
+		if (deb_str_has_null(deb_filenamebuff[deb_row(deb_filenamebuff_n+n4)],1000)!=1) continue;
 
-		if (strlen(deb_filenamebuff[deb_filenamebuff_n+n4])>=2000-4) continue;
+		if (strlen(deb_filenamebuff[deb_row(deb_filenamebuff_n+n4)])>=2000-4) continue;
 
-		strcpy(m11_str1,deb_filenamebuff[deb_filenamebuff_n+n4]);
+		strcpy(m11_str1,deb_filenamebuff[deb_row(deb_filenamebuff_n+n4)]);
 
 		if (deb_str_has_null(m11_str1,3000)!=1) continue;
 
@@ -7355,7 +8925,7 @@ static int deb_disp_dir(VideoState *cur_stream)
 				dirtype=deb_filenamebuff_type[i];
 				start=leftspace;
 
-				//printf("cur=%s,leftspace=%d,dirlen=%d,up=%s,\n",deb_filenamebuff[deb_filenamebuff_n+n4],leftspace,dirlen,
+				//printf("cur=%s,leftspace=%d,dirlen=%d,up=%s,\n",deb_filenamebuff[deb_row(deb_filenamebuff_n+n4)],leftspace,dirlen,
 				//				                  deb_filenamebuff[i]);
 			}
 			else
@@ -7378,7 +8948,7 @@ static int deb_disp_dir(VideoState *cur_stream)
 					dirtype=deb_filenamebuff_type[i];
 					start=leftspace;
 
-					//printf("cur=%s,leftspace=%d,dirlen=%d,up=%s,\n",deb_filenamebuff[deb_filenamebuff_n+n4],leftspace,dirlen,
+					//printf("cur=%s,leftspace=%d,dirlen=%d,up=%s,\n",deb_filenamebuff[deb_row(deb_filenamebuff_n+n4)],leftspace,dirlen,
 					//						  deb_filenamebuff[i]);
 				}
 				else
@@ -7390,18 +8960,18 @@ static int deb_disp_dir(VideoState *cur_stream)
 			}
 		}
 
-		c3=deb_getfirstchar(deb_filenamebuff[deb_filenamebuff_n+n4]);
+		c3=deb_getfirstchar(deb_filenamebuff[deb_row(deb_filenamebuff_n+n4)]);
 
 		if ((c3!='<')&&(c3!='|'))
 		{
-			if (leftspace+dirlen+35<=w-4)
+			if (leftspace+dirlen+45<=w-4)
 			{
 				filelen=leftspace+dirlen;
 				mi=0;
 			}
 			else
 			{
-				filelen=w-4-35;
+				filelen=w-4-45;
 				if (filelen>=(int)strlen(m11_str4)) mi=0;
 				else mi=1;
 			}
@@ -7516,22 +9086,30 @@ static int deb_disp_dir(VideoState *cur_stream)
 				for (n1=0;n1<(int)strlen(m11_str3);n1++) disp_buff[3+n4][n1+2]=m11_str3[n1];
 			}
 
-			for (j=0;j<(int)strlen(deb_filenamebuff_ext[deb_filenamebuff_n+n4]);j++)
+			deb_row_meta(deb_filenamebuff_n+n4);
+
+			for (j=0;j<(int)strlen(deb_filenamebuff_ext[deb_row(deb_filenamebuff_n+n4)]);j++)
 			{
 				if (j>=4) break;
-				disp_buff[3+n4][filelen+2+j+2]=deb_filenamebuff_ext[deb_filenamebuff_n+n4][j];
+				disp_buff[3+n4][filelen+2+j+2]=deb_filenamebuff_ext[deb_row(deb_filenamebuff_n+n4)][j];
 			}
 
-			for (j=0;j<(int)strlen(deb_filenamebuff_size[deb_filenamebuff_n+n4]);j++)
+			for (j=0;j<(int)strlen(deb_filenamebuff_size[deb_row(deb_filenamebuff_n+n4)]);j++)
 			{
 				if (j>=6) break;
-				disp_buff[3+n4][filelen+2+4+2+j+2]=deb_filenamebuff_size[deb_filenamebuff_n+n4][j];
+				disp_buff[3+n4][filelen+2+4+2+j+2]=deb_filenamebuff_size[deb_row(deb_filenamebuff_n+n4)][j];
 			}
 
-			for (j=0;j<(int)strlen(deb_filenamebuff_date[deb_filenamebuff_n+n4]);j++)
+			for (j=0;j<(int)strlen(deb_filenamebuff_date[deb_row(deb_filenamebuff_n+n4)]);j++)
 			{
 				if (j>=19) break;
-				disp_buff[3+n4][filelen+2+4+2+6+2+j+2]=deb_filenamebuff_date[deb_filenamebuff_n+n4][j];
+				disp_buff[3+n4][filelen+2+4+2+6+2+j+2]=deb_filenamebuff_date[deb_row(deb_filenamebuff_n+n4)][j];
+			}
+
+			for (j=0;j<(int)strlen(deb_filenamebuff_dur[deb_row(deb_filenamebuff_n+n4)]);j++)
+			{
+				if (j>=8) break;
+				disp_buff[3+n4][filelen+2+4+2+6+2+19+2+j+2]=deb_filenamebuff_dur[deb_row(deb_filenamebuff_n+n4)][j];
 			}
 
 		}
@@ -7600,50 +9178,161 @@ static int deb_disp_dir(VideoState *cur_stream)
 
 	}
 
+disp_draw:
 	bgcolor = SDL_MapRGB(screen->format, 0xFF, 0xFF, 0xFF);//daipozhi modified
 
-	fill_rectangle(screen,cur_stream->width -deb_ch_w*deb_ch_m ,0 , deb_ch_w*deb_ch_m , deb_ch_h*h, bgcolor,0); // daipozhi modified 
-
-	for (n4=0;n4<h;n4++)
+	if ((deb_disp_dir_valid==0)||(disp_old_h!=h)||(disp_old_w!=w)||(disp_old_width!=cur_stream->width))
 	{
-		if (n4>=1000) continue;
+		for (n4=0;n4<h;n4++) disp_buff_old_ok[n4]=0;
 
-		strpp=disp_buff[n4];
-		deb_echo_str4screenstring(cur_stream->width -deb_ch_w*deb_ch_m ,n4*deb_ch_h ,strpp ,deb_ch_m);
+		disp_old_n=deb_filenamebuff_n;
+		disp_old_h=h;
+		disp_old_w=w;
+		disp_old_width=cur_stream->width;
+		deb_disp_dir_valid=1;
 	}
 
-	n4=deb_filenameplay-deb_filenamebuff_n;
-	if ((n4>=0)&&(n4<h-4)) 
+	y1=h;
+	y2=(-1);
+
+	// scrolled, move the lines still on the screen and draw only the new ones
+	n3=deb_filenamebuff_n-disp_old_n;
+
+	if ((n3!=0)&&(n3<h-4)&&(n3>-(h-4)))
 	{
-		if (n4+3<1000)
+		if (n3>0)
+		{
+			rect1.y=(3+n3)*deb_ch_h;
+			rect2.y=3*deb_ch_h;
+		}
+		else
 		{
-		strpp=disp_buff[n4+3];
-		deb_echo_str4screenstringblack(cur_stream->width -deb_ch_w*deb_ch_m ,(n4+3)*deb_ch_h ,strpp ,deb_ch_m);
+			rect1.y=3*deb_ch_h;
+			rect2.y=(3-n3)*deb_ch_h;
 		}
+
+		rect1.x=cur_stream->width -deb_ch_w*deb_ch_m;
+		rect1.w=deb_ch_w*deb_ch_m;
+		rect1.h=(h-4-FFABS(n3))*deb_ch_h;
+		rect2.x=rect1.x;
+		rect2.w=rect1.w;
+		rect2.h=rect1.h;
+
+		SDL_BlitSurface(screen,&rect1,screen,&rect2);
+
+		if (n3>0)
+		{
+			for (n4=3;n4<h-1-n3;n4++)
+			{
+				memcpy(disp_buff_old[n4],disp_buff_old[n4+n3],w);
+				disp_buff_old_black[n4]=disp_buff_old_black[n4+n3];
+				disp_buff_old_ok[n4]   =disp_buff_old_ok[n4+n3];
+			}
+			for (n4=h-1-n3;n4<h-1;n4++) disp_buff_old_ok[n4]=0;
+		}
+		else
+		{
+			for (n4=h-2;n4>=3-n3;n4--)
+			{
+				memcpy(disp_buff_old[n4],disp_buff_old[n4+n3],w);
+				disp_buff_old_black[n4]=disp_buff_old_black[n4+n3];
+				disp_buff_old_ok[n4]   =disp_buff_old_ok[n4+n3];
+			}
+			for (n4=3;n4<3-n3;n4++) disp_buff_old_ok[n4]=0;
+		}
+
+		y1=3;
+		y2=h-2;
+	}
+	else if (n3!=0)
+	{
+		for (n4=0;n4<h;n4++) disp_buff_old_ok[n4]=0;
+	}
+
+	disp_old_n=deb_filenamebuff_n;
+
+	if (deb_search_on==1) n5=deb_search_sel-deb_search_n;
+	else n5=deb_filenameplay-deb_filenamebuff_n;
+
+	for (n4=0;n4<h;n4++)
+	{
+		if (n4>=1000) continue;
+
+		if ((n4>=3)&&(n4-3==n5)&&(n5<h-4)) c3=1;
+		else c3=0;
+
+		if ((disp_buff_old_ok[n4]==1)&&(disp_buff_old_black[n4]==c3)&&
+		    (memcmp(disp_buff_old[n4],disp_buff[n4],w)==0)) continue;
+
+		fill_rectangle(screen,cur_stream->width -deb_ch_w*deb_ch_m ,n4*deb_ch_h , deb_ch_w*deb_ch_m , deb_ch_h, bgcolor,0); // daipozhi modified 
+
+		strpp=disp_buff[n4];
+
+		if (c3==1) deb_echo_str4screenstringblack(cur_stream->width -deb_ch_w*deb_ch_m ,n4*deb_ch_h ,strpp ,deb_ch_m);
+		else       deb_echo_str4screenstring     (cur_stream->width -deb_ch_w*deb_ch_m ,n4*deb_ch_h ,strpp ,deb_ch_m);
+
+		memcpy(disp_buff_old[n4],disp_buff[n4],w);
+		disp_buff_old_black[n4]=c3;
+		disp_buff_old_ok[n4]=1;
+
+		if (n4<y1) y1=n4;
+		if (n4>y2) y2=n4;
 	}
 
-	SDL_UpdateRect(screen,cur_stream->width -deb_ch_w*deb_ch_m, 0, deb_ch_w*deb_ch_m , deb_ch_h*h);//daipozhi modified
+	if (y2>=y1) SDL_UpdateRect(screen,cur_stream->width -deb_ch_w*deb_ch_m, y1*deb_ch_h, deb_ch_w*deb_ch_m , (y2-y1+1)*deb_ch_h);//daipozhi modified
+
+	deb_probe_view(h);
 
 	return(0);
 }
 
 
-static int deb_get_dir_len(int pp)
+static char m107_path[3000];
+
+// size and date of a file row, read once when the row is first shown
+static int deb_row_meta(int pp)
 {
-    int i,j,k;
+	int i;
+#if !defined(_WIN32) && !defined(__APPLE__)
+	struct stat64 info;
+#else
+	struct stat   info;
+#endif
 
-    i=deb_get_space(deb_filenamebuff[pp]);
+	i=deb_row(pp);
+	if (i<0) return(0);
 
-    while(pp>0)
-    {
-	pp--;
-	j=deb_get_space(deb_filenamebuff[pp]);
-	if (j<i) break;
-    }
+	if (deb_filenamebuff_size[i][0]!=0) return(0);
+
+	deb_get_path_to(pp,m107_path);
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+	if ((m107_path[0]==0)||(stat64(m107_path,&info)!=0))
+#else
+	if ((m107_path[0]==0)||(stat(m107_path,&info)!=0))
+#endif
+	{
+		strcpy(deb_filenamebuff_size[i],"****  ");
+		strcpy(deb_filenamebuff_date[i],"****               ");
+		return(0);
+	}
 
-    k=pp;
+	deb_size_string(info.st_size,deb_filenamebuff_size[i]);
+	deb_date_string(info.st_mtime,deb_filenamebuff_date[i]);
 
-    return(k);
+	return(0);
+}
+
+// slot of the folder row that holds row pp
+static int deb_get_dir_len(int pp)
+{
+    int i;
+
+    i=deb_row(pp);
+    if (i<0) return(-1);
+
+    if (deb_filenamebuff_parent[i]>=0) return(deb_filenamebuff_parent[i]);
+    else return(i);
 }
 
 static int deb_disp_bar(VideoState *is)
@@ -9239,8 +10928,6 @@ int main(void)
 
 static char          m202_buffer1[3000];
 static char          m202_buffer2[3000];
-static char	     m202_buffer4[300];
-static char          m202_buffer5[3000];
 static char          m202_buffer6[3000];
 static char          m202_buffer7[3000];
 static char          m202_type;
@@ -9254,14 +10941,99 @@ static char          m202_date[20];
 // 2017-01-01 08:15:01
 // 1234567890123456789
 
+// classify and name one directory entry into m202_buffer2/type/ext,
+// called by bt_opendir() and by the folder reading thread
+static int  bt_entry(char *path,int dfd,struct dirent *entry)
+{
+    int           i,j;
+    char         *d_name;
+
+	d_name=entry->d_name;
+
+	i=deb_filename_dir(path,dfd,entry);
+
+	if (i==1)
+	{
+		if (deb_str_has_null(d_name,1000)!=1) return(-1);
+
+		if (strlen(d_name)>=1000-2) return(-1);
+
+		strcpy(m202_buffer2,"<");
+		av_strlcat(m202_buffer2,d_name,1000);
+		av_strlcat(m202_buffer2,">",1000);
+
+		m202_type=0;
+		m202_ext[0] =0;
+		m202_size[0]=0;
+		m202_date[0]=0;
+
+		//deb_utf8_to_gb18030(m202_buffer2,m202_buffer7,3000);
+		//j=(int)strlen(m202_buffer7);
+		//if (deb_m_info_len<j) deb_m_info_len=j;
+
+	}
+	else
+	{
+		if (deb_str_has_null(d_name,1000)!=1) return(-1);
+
+		if (strlen(d_name)>=1000-2) return(-1);
+
+		strcpy(m202_buffer2,d_name);
+
+		deb_m_info_type=1;
+
+		// type
+		m202_type=1;
+
+		// ext
+		deb_filenameext(d_name,m202_buffer1);
+		if (((int)strlen(m202_buffer1)>4)||
+		    ((int)strlen(m202_buffer1)<=0))
+		{
+			strcpy(m202_ext,"    ");
+		}
+		else
+		{
+			strcat(m202_buffer1,"    ");
+			m202_buffer1[4]=0;
+			str_lower_string(m202_buffer1,m202_ext);
+		}
+
+		// size and date are read when the row is shown, see deb_row_meta()
+		m202_size[0]=0;
+		m202_date[0]=0;
+
+		//deb_utf8_to_gb18030(m202_buffer2,m202_buffer7,3000);
+		//j=(int)strlen(m202_buffer7);
+		//if (deb_m_info_len<j) deb_m_info_len=j;
+
+		for (j=0;j<3000;j++)
+		{
+			m202_buffer7[j]=0;
+		}
+
+		#if !defined(_WIN32) && !defined(__APPLE__)
+			deb_utf8_to_gb18030(m202_buffer2,m202_buffer7,3000);
+		#else
+			strcpy(m202_buffer7,m202_buffer2);
+		#endif
+
+		j=(int)strlen(m202_buffer7);
+
+		if (deb_m_info_len<j) deb_m_info_len=j;
+
+	}
+
+	return(0);
+}
+
 static int  bt_opendir(void)
 {
   DIR           *dirp;
   struct dirent *entry;
 
-    int           i,j;
+    int           i,dfd;
     //char          buffer2[3000];
-    char buffer3[20];
     //char buffer4[300];
 
         //deb_record_init();
@@ -9278,6 +11050,12 @@ static int  bt_opendir(void)
 
 	if (dirp = opendir(deb_currentpath))
         {
+#if !defined(_WIN32)
+		dfd=dirfd(dirp);
+#else
+		dfd=(-1);
+#endif
+
 		while (1)
 		{
 			if (entry = readdir(dirp))
@@ -9285,242 +11063,183 @@ static int  bt_opendir(void)
 				if (strcmp(entry->d_name,".") ==0) continue;
 				if (strcmp(entry->d_name,"..")==0) continue;
 
-				i=deb_filename_dir(deb_currentpath,entry->d_name);
+				if (bt_entry(deb_currentpath,dfd,entry)!=0) continue;
 
-				if (i==1)
-				{
-					if (deb_str_has_null(entry->d_name,1000)!=1) continue;
+			        insert_node(m202_buffer2,m202_type);
+				strcpy(node_val3[find_pp2],m202_ext);
+				strcpy(node_val4[find_pp2],m202_size);
+				strcpy(node_val5[find_pp2],m202_date);
+			}
+			else break;
+		}
 
-					if (strlen(entry->d_name)>=1000-2) continue;
+		after_list(1);
 
-					strcpy(m202_buffer2,"<");
-					av_strlcat(m202_buffer2,entry->d_name,1000);
-					av_strlcat(m202_buffer2,">",1000);
+		for (i=0;i<out_pp;i++)
+		{
+			if (i<0) continue;
+			if (i>=3000) continue;
 
-					m202_type=0;
-					m202_ext[0] =0;
-					m202_size[0]=0;
-					m202_date[0]=0;
+			if (out_mixed_pp<0) continue;
+			if (out_mixed_pp>=3000) continue;
 
-				        insert_node(m202_buffer2,m202_type);
-					//node_val2[find_pp2]=0;
-					strcpy(node_val3[find_pp2],m202_ext);
-					strcpy(node_val4[find_pp2],m202_size);
-					strcpy(node_val5[find_pp2],m202_date);
+			if (deb_str_has_null(out_buff[i],1000)!=1) continue;
 
-					//deb_utf8_to_gb18030(m202_buffer2,m202_buffer7,3000);
-					//j=(int)strlen(m202_buffer7);
-					//if (deb_m_info_len<j) deb_m_info_len=j;
+			if (strlen(out_buff[i])>=1000) continue;
 
-				}
-				else
-				{
-					if (deb_str_has_null(entry->d_name,1000)!=1) continue;
+			strcpy(out_mixed_buff[out_mixed_pp],out_buff[i]);
+
+			out_mixed_buff2[out_mixed_pp]=out_buff2[i];
+
+			strcpy(out_mixed_buff3[out_mixed_pp],out_buff3[i]);
+			strcpy(out_mixed_buff4[out_mixed_pp],out_buff4[i]);
+			strcpy(out_mixed_buff5[out_mixed_pp],out_buff5[i]);
+
+			//sprintf(m202_buffer6,"%20s,%c,%s,%s,%s",out_buff[i],out_buff2[i],out_buff3[i],out_buff4[i],out_buff5[i]);
+			//deb_record(m202_buffer6);
 
-					if (strlen(entry->d_name)>=1000-2) continue;
+			out_mixed_pp++;
+
+			if (out_mixed_pp>=TREE2_SIZE) return(-1);
+		}
 
-					strcpy(m202_buffer2,entry->d_name);
+	}
+	else return(-1);
 
-					deb_m_info_type=1;
+	closedir(dirp);
+	
+	return(0);
+}
 
-					// type
-					m202_type=1;
+// "1.23MB" style size column
+static int deb_size_string(int64_t size,char *buffer)
+{
+	int  j;
+	char buffer3[20];
+	char buffer4[300];
 
-					// ext
-					deb_filenameext(entry->d_name,m202_buffer1);
-					if (((int)strlen(m202_buffer1)>4)||
-					    ((int)strlen(m202_buffer1)<=0))
+						//          t  g  m  k  b
+	if ((size<0)||(size>=1000000000000000))
+	{
+		strcpy(buffer,"****  ");
+	}
+	else
+	{
+				//      t  g  m  k  b
+		if (size>=1000000000000)
+		{
+			strcpy(buffer3,"TB");
+					//    g  m  k  b
+			j=size/10000000000;
+			deb_size_format(j,buffer4);
+			if (((int)strlen(buffer4)<=4)&&((int)strlen(buffer4)>=0)) 
+			{
+				strcpy(buffer,buffer4);
+				strcat(buffer,buffer3);
+			}
+			else
+			{
+				strcpy(buffer,"****");
+				strcat(buffer,buffer3);
+			}
+		}
+		else
+		{
+					//      g  m  k  b
+			if (size>=1000000000)
+			{
+				strcpy(buffer3,"GB");
+						//    m  k  b
+				j=size/10000000;
+				deb_size_format(j,buffer4);
+				if (((int)strlen(buffer4)<=4)&&((int)strlen(buffer4)>=0)) 
+				{
+					strcpy(buffer,buffer4);
+					strcat(buffer,buffer3);
+				}
+				else
+				{
+					strcpy(buffer,"****");
+					strcat(buffer,buffer3);
+				}
+			}
+			else
+			{
+						//      m  k  b
+				if (size>=1000000)
+				{
+					strcpy(buffer3,"MB");
+							//    k  b
+					j=size/10000;
+					deb_size_format(j,buffer4);
+					if (((int)strlen(buffer4)<=4)&&((int)strlen(buffer4)>=0)) 
 					{
-						strcpy(m202_ext,"    ");
+						strcpy(buffer,buffer4);
+						strcat(buffer,buffer3);
 					}
 					else
 					{
-						strcat(m202_buffer1,"    ");
-						m202_buffer1[4]=0;
-						str_lower_string(m202_buffer1,m202_ext);
+						strcpy(buffer,"****");
+						strcat(buffer,buffer3);
 					}
-
-					//size
-										//          t  g  m  k  b
-					if ((deb_m_info.st_size<0)||(deb_m_info.st_size>=1000000000000000))
+				}
+				else
+				{
+							//      k  b
+					if (size>=1000)
 					{
-						strcpy(m202_size,"****  ");
+						strcpy(buffer3,"KB");
+								//    b
+						j=size/10;
+						deb_size_format(j,buffer4);
+						if (((int)strlen(buffer4)<=4)&&((int)strlen(buffer4)>=0)) 
+						{
+							strcpy(buffer,buffer4);
+							strcat(buffer,buffer3);
+						}
+						else
+						{
+							strcpy(buffer,"****");
+							strcat(buffer,buffer3);
+						}
 					}
 					else
 					{
-								//      t  g  m  k  b
-						if (deb_m_info.st_size>=1000000000000)
+						strcpy(buffer3,"B ");
+
+						j=size;
+						sprintf(buffer4,"%4d",j);
+						if (((int)strlen(buffer4)<=4)&&((int)strlen(buffer4)>=0)) 
 						{
-							strcpy(buffer3,"TB");
-									//    g  m  k  b
-							j=deb_m_info.st_size/10000000000;
-							deb_size_format(j,m202_buffer4);
-							if (((int)strlen(m202_buffer4)<=4)&&((int)strlen(m202_buffer4)>=0)) 
-							{
-								strcpy(m202_size,m202_buffer4);
-								strcat(m202_size,buffer3);
-							}
-							else
-							{
-								strcpy(m202_size,"****");
-								strcat(m202_size,buffer3);
-							}
+							strcpy(buffer,buffer4);
+							strcat(buffer,buffer3);
 						}
 						else
 						{
-									//      g  m  k  b
-							if (deb_m_info.st_size>=1000000000)
-							{
-								strcpy(buffer3,"GB");
-										//    m  k  b
-								j=deb_m_info.st_size/10000000;
-								deb_size_format(j,m202_buffer4);
-								if (((int)strlen(m202_buffer4)<=4)&&((int)strlen(m202_buffer4)>=0)) 
-								{
-									strcpy(m202_size,m202_buffer4);
-									strcat(m202_size,buffer3);
-								}
-								else
-								{
-									strcpy(m202_size,"****");
-									strcat(m202_size,buffer3);
-								}
-							}
-							else
-							{
-										//      m  k  b
-								if (deb_m_info.st_size>=1000000)
-								{
-									strcpy(buffer3,"MB");
-											//    k  b
-									j=deb_m_info.st_size/10000;
-									deb_size_format(j,m202_buffer4);
-									if (((int)strlen(m202_buffer4)<=4)&&((int)strlen(m202_buffer4)>=0)) 
-									{
-										strcpy(m202_size,m202_buffer4);
-										strcat(m202_size,buffer3);
-									}
-									else
-									{
-										strcpy(m202_size,"****");
-										strcat(m202_size,buffer3);
-									}
-								}
-								else
-								{
-											//      k  b
-									if (deb_m_info.st_size>=1000)
-									{
-										strcpy(buffer3,"KB");
-												//    b
-										j=deb_m_info.st_size/10;
-										deb_size_format(j,m202_buffer4);
-										if (((int)strlen(m202_buffer4)<=4)&&((int)strlen(m202_buffer4)>=0)) 
-										{
-											strcpy(m202_size,m202_buffer4);
-											strcat(m202_size,buffer3);
-										}
-										else
-										{
-											strcpy(m202_size,"****");
-											strcat(m202_size,buffer3);
-										}
-									}
-									else
-									{
-										strcpy(buffer3,"B ");
-
-										j=deb_m_info.st_size;
-										sprintf(m202_buffer4,"%4d",j);
-										if (((int)strlen(m202_buffer4)<=4)&&((int)strlen(m202_buffer4)>=0)) 
-										{
-											strcpy(m202_size,m202_buffer4);
-											strcat(m202_size,buffer3);
-										}
-										else
-										{
-											strcpy(m202_size,"****");
-											strcat(m202_size,buffer3);
-										}
-									}
-								}
-							}
+							strcpy(buffer,"****");
+							strcat(buffer,buffer3);
 						}
 					}
-
-					//time
-					deb_m_info_tm=localtime(&(deb_m_info.st_mtime));
-					sprintf(m202_buffer5,"%4d-%2d-%2d %2d:%2d:%2d",1900+deb_m_info_tm->tm_year,1+deb_m_info_tm->tm_mon,deb_m_info_tm->tm_mday,
-										       deb_m_info_tm->tm_hour,deb_m_info_tm->tm_min,deb_m_info_tm->tm_sec);
-					if ((int)strlen(m202_buffer5)!=19) strcpy(m202_buffer5,"****               ");
-					strcpy(m202_date,m202_buffer5);
-
-				        insert_node(m202_buffer2,m202_type);
-					//node_val2[find_pp2]=1;
-					strcpy(node_val3[find_pp2],m202_ext);
-					strcpy(node_val4[find_pp2],m202_size);
-					strcpy(node_val5[find_pp2],m202_date);
-
-					//deb_utf8_to_gb18030(m202_buffer2,m202_buffer7,3000);
-					//j=(int)strlen(m202_buffer7);
-					//if (deb_m_info_len<j) deb_m_info_len=j;
-
-					for (j=0;j<3000;j++)
-					{
-						m202_buffer7[j]=0;
-					}
-
-					#if !defined(_WIN32) && !defined(__APPLE__)
-						deb_utf8_to_gb18030(m202_buffer2,m202_buffer7,3000);
-					#else
-						strcpy(m202_buffer7,m202_buffer2);
-					#endif
-
-					j=(int)strlen(m202_buffer7);
-
-					if (deb_m_info_len<j) deb_m_info_len=j;
-
 				}
-
 			}
-			else break;
 		}
+	}
 
-		after_list(1);
-
-		for (i=0;i<out_pp;i++)
-		{
-			if (i<0) continue;
-			if (i>=3000) continue;
-
-			if (out_mixed_pp<0) continue;
-			if (out_mixed_pp>=3000) continue;
-
-			if (deb_str_has_null(out_buff[i],1000)!=1) continue;
-
-			if (strlen(out_buff[i])>=1000) continue;
-
-			strcpy(out_mixed_buff[out_mixed_pp],out_buff[i]);
-
-			out_mixed_buff2[out_mixed_pp]=out_buff2[i];
-
-			strcpy(out_mixed_buff3[out_mixed_pp],out_buff3[i]);
-			strcpy(out_mixed_buff4[out_mixed_pp],out_buff4[i]);
-			strcpy(out_mixed_buff5[out_mixed_pp],out_buff5[i]);
-
-			//sprintf(m202_buffer6,"%20s,%c,%s,%s,%s",out_buff[i],out_buff2[i],out_buff3[i],out_buff4[i],out_buff5[i]);
-			//deb_record(m202_buffer6);
-
-			out_mixed_pp++;
+	return(0);
+}
 
-			if (out_mixed_pp>=TREE2_SIZE) return(-1);
-		}
+// "2017-01-01 08:15:01" style date column
+static int deb_date_string(time_t mtime,char *buffer)
+{
+	struct tm *tm1;
+	char       buffer5[300];
 
-	}
-	else return(-1);
+	tm1=localtime(&mtime);
+	sprintf(buffer5,"%4d-%2d-%2d %2d:%2d:%2d",1900+tm1->tm_year,1+tm1->tm_mon,tm1->tm_mday,
+						       tm1->tm_hour,tm1->tm_min,tm1->tm_sec);
+	if ((int)strlen(buffer5)!=19) strcpy(buffer5,"****               ");
+	strcpy(buffer,buffer5);
 
-	closedir(dirp);
-	
 	return(0);
 }
 
@@ -9611,6 +11330,3700 @@ static int  bt_readdir(void)
 	return(-1);
 }
 
+static char m206_path[3000];
+static char m206_str1[3000];
+static char m206_str2[3000];
+static char m206_s1[3000];
+
+// daipozhi modified for reading folder in thread
+static int deb_scan_init(void)
+{
+	deb_scan_slot=(-1);
+	deb_scan_want=0;
+	deb_scan_bfull=0;
+
+	deb_scan_mutex=SDL_CreateMutex();
+	deb_scan_cond =SDL_CreateCond();
+
+	if ((!deb_scan_mutex)||(!deb_scan_cond))
+	{
+		deb_scan_tid=NULL;
+		return(-1);
+	}
+
+	deb_scan_tid=SDL_CreateThread(deb_scan_thread,NULL);
+	if (!deb_scan_tid)
+	{
+		av_log(NULL, AV_LOG_ERROR, "SDL_CreateThread(): %s\n", SDL_GetError());
+		return(-1);
+	}
+
+	return(0);
+}
+
+// hand the batch to the event thread and wait till it is taken
+static int deb_scan_post(int serial,int n,int done)
+{
+	SDL_Event event;
+
+	SDL_LockMutex(deb_scan_mutex);
+
+	if (serial!=deb_scan_serial)
+	{
+		SDL_UnlockMutex(deb_scan_mutex);
+		return(-1);
+	}
+
+	deb_scan_bserial=serial;
+	deb_scan_bcnt   =n;
+	deb_scan_bdone  =done;
+	deb_scan_blen   =deb_m_info_len;
+	deb_scan_btype  =deb_m_info_type;
+	deb_scan_bfull  =1;
+
+	event.type = FF_DIR_EVENT;
+	event.user.data1 = NULL;
+	deb_push_event(&event);
+
+	while ((deb_scan_bfull==1)&&(serial==deb_scan_serial)) SDL_CondWait(deb_scan_cond,deb_scan_mutex);
+
+	SDL_UnlockMutex(deb_scan_mutex);
+
+	if (serial!=deb_scan_serial) return(-1);
+	else return(0);
+}
+
+static int deb_scan_thread(void *arg)
+{
+	DIR           *dirp;
+	struct dirent *entry;
+	int            serial,n,t,j,dfd;
+
+	while (1)
+	{
+		SDL_LockMutex(deb_scan_mutex);
+
+		while (deb_scan_want==0) SDL_CondWait(deb_scan_cond,deb_scan_mutex);
+
+		deb_scan_want=0;
+		deb_scan_busy=1;
+		serial=deb_scan_serial;
+		strcpy(m206_path,deb_scan_path);
+
+		SDL_UnlockMutex(deb_scan_mutex);
+
+		deb_m_info_len =0;
+		deb_m_info_type=0;
+
+		n=0;
+		t=0;
+
+		dirp=opendir(m206_path);
+
+#if !defined(_WIN32)
+		if (dirp) dfd=dirfd(dirp);
+		else dfd=(-1);
+#else
+		dfd=(-1);
+#endif
+
+		while (dirp)
+		{
+			if (serial!=deb_scan_serial) break;
+
+			entry=readdir(dirp);
+			if (!entry) break;
+
+			if (strcmp(entry->d_name,".") ==0) continue;
+			if (strcmp(entry->d_name,"..")==0) continue;
+
+			if (bt_entry(m206_path,dfd,entry)!=0) continue;
+
+			strcpy(deb_scan_bname[n],m202_buffer2);
+			strcpy(deb_scan_bext[n] ,m202_ext);
+			strcpy(deb_scan_bsize[n],m202_size);
+			strcpy(deb_scan_bdate[n],m202_date);
+
+			// same order as search_node(), folders first
+			str_lower_string(m202_buffer2,m206_str1);
+
+			for (j=0;j<3000;j++) m206_str2[j]=0;
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+			deb_utf8_to_gb18030(m206_str1,m206_str2,3000);
+#else
+			strcpy(m206_str2,m206_str1);
+#endif
+			m206_str2[1000-1]=0;
+
+			deb_scan_bkey[n][0]=(char)('0'+m202_type);
+			strcpy(deb_scan_bkey[n]+1,m206_str2);
+
+			n++;
+			t++;
+
+			if (t>=TREE2_SIZE) break;
+
+			if (n>=DEB_SCAN_BATCH)
+			{
+				if (deb_scan_post(serial,n,0)!=0) break;
+				n=0;
+			}
+		}
+
+		if (dirp) closedir(dirp);
+
+		deb_scan_post(serial,n,1);
+
+		SDL_LockMutex(deb_scan_mutex);
+		deb_scan_busy=0;
+		SDL_CondBroadcast(deb_scan_cond);
+		SDL_UnlockMutex(deb_scan_mutex);
+	}
+
+	return(0);
+}
+
+// start reading the folder at row pp (path in deb_dir_buffer),
+// the rows come in by FF_DIR_EVENT
+static int deb_scan_start(int pp)
+{
+	int i,j,k;
+
+	if (pp<0) return(0);
+	if (pp>=deb_filenamecnt) return(0);
+
+	if (!deb_scan_tid) return(deb_scan_now(pp));
+
+	if (deb_scan_slot>=0)
+	{
+		// a folder inside the one being read, wait for it
+		i=deb_row(pp);
+		j=0;
+		while (i>=0)
+		{
+			if (i==deb_scan_slot) return(0);
+			i=deb_filenamebuff_parent[i];
+			j++;
+			if (j>=10000) break;
+		}
+
+		// stop the old one, it is closed again
+		i=deb_row(pp);
+		j=deb_row_find(deb_scan_slot);
+		if (j>=0) deb_dir_remove_after(j);
+		pp=deb_row_find(i);
+		if (pp<0) return(0);
+	}
+
+	if (deb_dcache_get(deb_dir_buffer,pp)==0) return(0);
+	if (deb_lib_get(deb_dir_buffer,pp)==0) return(0);
+
+	deb_scan_keycnt=0;
+
+	m206_s1[0]=0;
+
+	j=deb_get_space(deb_filenamebuff[deb_row(pp)]);
+	for (k=0;k<j;k++)
+	{
+		m206_s1[k+0]=' ';
+		m206_s1[k+1]=0;
+	}
+
+	k=deb_row_insert(pp+1);
+	if (k<0) return(0);
+
+	strcpy(deb_filenamebuff[k],m206_s1);
+	strcat(deb_filenamebuff[k],"  ");
+	strcat(deb_filenamebuff[k],"|Reading Fold|");
+
+	strcpy(deb_filenamebuff_ext[k],"    ");
+	strcpy(deb_filenamebuff_size[k],"      ");
+	strcpy(deb_filenamebuff_date[k],"                   ");
+
+	deb_row_set_name(k,deb_row(pp));
+
+	deb_filenamebuff_len[deb_row(pp)] =14;
+	deb_filenamebuff_type[deb_row(pp)]=0;
+
+	if (pp<deb_filenameplay) deb_filenameplay++;
+
+	SDL_LockMutex(deb_scan_mutex);
+
+	deb_scan_serial++;
+	deb_scan_slot=deb_row(pp);
+	strcpy(deb_scan_path,deb_dir_buffer);
+	deb_scan_want=1;
+	deb_scan_bfull=0;
+
+	SDL_CondSignal(deb_scan_cond);
+	SDL_UnlockMutex(deb_scan_mutex);
+
+	return(0);
+}
+
+static int deb_scan_cancel(void)
+{
+	if (deb_scan_slot<0) return(0);
+
+	deb_scan_slot=(-1);
+
+	if (!deb_scan_tid) return(0);
+
+	SDL_LockMutex(deb_scan_mutex);
+
+	deb_scan_serial++;
+	deb_scan_bfull=0;
+
+	SDL_CondSignal(deb_scan_cond);
+	SDL_UnlockMutex(deb_scan_mutex);
+
+	return(0);
+}
+
+// cancel the thread and wait till it is out of bt_entry(), before reading a folder here
+static int deb_scan_wait(void)
+{
+	deb_scan_cancel();
+
+	if (!deb_scan_tid) return(0);
+
+	SDL_LockMutex(deb_scan_mutex);
+
+	if (deb_scan_busy==1)
+	{
+		deb_scan_serial++;
+		deb_scan_bfull=0;
+		SDL_CondSignal(deb_scan_cond);
+	}
+
+	while (deb_scan_busy==1) SDL_CondWait(deb_scan_cond,deb_scan_mutex);
+
+	SDL_UnlockMutex(deb_scan_mutex);
+
+	return(0);
+}
+
+// put one batch of rows into the folder, sorted like bt_opendir()
+static int deb_scan_batch(VideoState *is)
+{
+	int i,j,k,l,m,pp,row;
+
+	SDL_LockMutex(deb_scan_mutex);
+
+	if ((deb_scan_bfull!=1)||(deb_scan_bserial!=deb_scan_serial)||(deb_scan_slot<0))
+	{
+		SDL_UnlockMutex(deb_scan_mutex);
+		return(0);
+	}
+
+	pp=deb_row_find(deb_scan_slot);
+	if (pp<0)
+	{
+		SDL_UnlockMutex(deb_scan_mutex);
+		return(0);
+	}
+
+	m206_s1[0]=0;
+
+	j=deb_get_space(deb_filenamebuff[deb_row(pp)]);
+	for (k=0;k<j;k++)
+	{
+		m206_s1[k+0]=' ';
+		m206_s1[k+1]=0;
+	}
+
+	for (i=0;i<deb_scan_bcnt;i++)
+	{
+		if (deb_scan_keycnt>=3000) break;
+
+		if (strlen(deb_scan_bname[i])+strlen(m206_s1)+2>=1000) continue;
+
+		// binary search, equal keys go after
+		l=0;
+		m=deb_scan_keycnt;
+		while (l<m)
+		{
+			k=(l+m)/2;
+			if (strcmp(deb_scan_key[deb_scan_keyord[k]],deb_scan_bkey[i])<=0) l=k+1;
+			else m=k;
+		}
+
+		row=pp+1+l;
+
+		k=deb_row_insert(row);
+		if (k<0) break;
+
+		strcpy(deb_filenamebuff[k],m206_s1);
+		strcat(deb_filenamebuff[k],"  ");
+		strcat(deb_filenamebuff[k],deb_scan_bname[i]);
+
+		strcpy(deb_filenamebuff_ext[k] ,deb_scan_bext[i]);
+		strcpy(deb_filenamebuff_size[k],deb_scan_bsize[i]);
+		strcpy(deb_filenamebuff_date[k],deb_scan_bdate[i]);
+
+		if (deb_scan_bkey[i][0]=='0') deb_filenamebuffpp[k]=2;
+		else deb_filenamebuffpp[k]=1;
+
+		deb_row_set_name(k,deb_scan_slot);
+
+		strcpy(deb_scan_key[deb_scan_keycnt],deb_scan_bkey[i]);
+
+		memmove(&deb_scan_keyord[l+1],&deb_scan_keyord[l],(deb_scan_keycnt-l)*sizeof(int));
+		deb_scan_keyord[l]=deb_scan_keycnt;
+		deb_scan_keycnt++;
+
+		if (row<=deb_filenameplay) deb_filenameplay++;
+	}
+
+	if (deb_scan_keycnt>0)
+	{
+		deb_filenamebuff_len[deb_scan_slot] =deb_scan_blen;
+		deb_filenamebuff_type[deb_scan_slot]=deb_scan_btype;
+	}
+
+	if (deb_scan_bdone==1)
+	{
+		row=pp+1+deb_scan_keycnt;
+
+		if (deb_scan_keycnt>0)
+		{
+			if (row<deb_filenameplay) deb_filenameplay--;
+			deb_row_delete(row);
+		}
+		else
+		{
+			k=deb_row(row);
+			if (k>=0)
+			{
+				strcpy(deb_filenamebuff[k],m206_s1);
+				strcat(deb_filenamebuff[k],"  ");
+				strcat(deb_filenamebuff[k],"|Empty Fold|");
+
+				deb_row_set_name(k,deb_scan_slot);
+			}
+
+			deb_filenamebuff_len[deb_scan_slot] =12;
+			deb_filenamebuff_type[deb_scan_slot]=0;
+		}
+
+		deb_dcache_put(deb_scan_path,pp);
+
+		deb_scan_slot=(-1);
+	}
+
+	deb_scan_bfull=0;
+
+	SDL_CondSignal(deb_scan_cond);
+	SDL_UnlockMutex(deb_scan_mutex);
+
+	deb_disp_dir(is);
+
+	return(0);
+}
+
+// display row of a slot
+static int deb_row_find(int slot)
+{
+	int i;
+
+	if (slot<0) return(-1);
+
+	for (i=0;i<deb_filenamecnt;i++)
+	{
+		if (deb_row(i)==slot) return(i);
+	}
+
+	return(-1);
+}
+
+static char m207_s1[3000];
+
+// daipozhi modified for folder cache
+static int deb_dcache_init(void)
+{
+	int i;
+
+	for (i=0;i<DEB_DCACHE_NUM;i++)
+	{
+		deb_dcache_path[i][0]=0;
+		deb_dcache_buff[i]=NULL;
+		deb_dcache_wd[i]=(-1);
+	}
+
+	deb_dcache_total=0;
+	deb_dcache_tick=0;
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+	deb_dcache_ifd=inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+#else
+	deb_dcache_ifd=(-1);
+#endif
+
+	return(0);
+}
+
+static int deb_dcache_drop(int i)
+{
+	if ((i<0)||(i>=DEB_DCACHE_NUM)) return(0);
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+	if ((deb_dcache_ifd>=0)&&(deb_dcache_wd[i]>=0)) inotify_rm_watch(deb_dcache_ifd,deb_dcache_wd[i]);
+#endif
+
+	av_freep(&deb_dcache_buff[i]);
+
+	deb_dcache_total=deb_dcache_total-deb_dcache_bytes[i];
+
+	deb_dcache_path[i][0]=0;
+	deb_dcache_bytes[i]=0;
+	deb_dcache_cnt[i]=0;
+	deb_dcache_wd[i]=(-1);
+
+	return(0);
+}
+
+// drop the listings of folders changed since they were read
+static int deb_dcache_notify(void)
+{
+#if !defined(_WIN32) && !defined(__APPLE__)
+	char  buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *ev;
+	int   i,n,p1;
+
+	if (deb_dcache_ifd<0) return(0);
+
+	while (1)
+	{
+		n=read(deb_dcache_ifd,buffer,sizeof(buffer));
+		if (n<=0) break;
+
+		for (p1=0;p1+(int)sizeof(struct inotify_event)<=n;p1=p1+sizeof(struct inotify_event)+ev->len)
+		{
+			ev=(struct inotify_event *)(buffer+p1);
+
+			for (i=0;i<DEB_DCACHE_NUM;i++)
+			{
+				if ((deb_dcache_buff[i])&&(deb_dcache_wd[i]==ev->wd))
+				{
+					if (ev->mask&IN_IGNORED) deb_dcache_wd[i]=(-1);
+					deb_dcache_drop(i);
+				}
+			}
+		}
+	}
+#endif
+
+	return(0);
+}
+
+// keep the listing now under folder row pp
+static int deb_dcache_put(char *path,int pp)
+{
+	int   i,j,k,l,m,n,slot;
+	char *p;
+#if !defined(_WIN32) && !defined(__APPLE__)
+	struct stat64 info;
+#else
+	struct stat   info;
+#endif
+
+	if (pp<0) return(0);
+	if (pp>=deb_filenamecnt) return(0);
+	if (strlen(path)>=3000) return(0);
+
+	slot=deb_row(pp);
+	m=deb_get_space(deb_filenamebuff[slot])+2;
+
+	// size it
+	n=0;
+	k=0;
+	for (j=pp+1;j<deb_filenamecnt;j++)
+	{
+		i=deb_row(j);
+		if (deb_filenamebuff_parent[i]!=slot) break;
+		if (deb_getfirstchar(deb_filenamebuff[i])=='|') continue;
+
+		n=n+1+6+strlen(deb_filenamebuff[i]+m)+1;
+		k++;
+	}
+
+	if (n+1>DEB_DCACHE_BYTES/4) return(0);
+
+	for (i=0;i<DEB_DCACHE_NUM;i++)
+	{
+		if ((deb_dcache_buff[i])&&(strcmp(deb_dcache_path[i],path)==0)) deb_dcache_drop(i);
+	}
+
+	// free room, least used first
+	while (1)
+	{
+		l=(-1);
+		j=0;
+
+		for (i=0;i<DEB_DCACHE_NUM;i++)
+		{
+			if (!deb_dcache_buff[i])
+			{
+				if (l<0) l=i;
+			}
+			else j++;
+		}
+
+		if ((l>=0)&&(deb_dcache_total+n+1<=DEB_DCACHE_BYTES)) break;
+		if (j==0) return(0);
+
+		l=(-1);
+		for (i=0;i<DEB_DCACHE_NUM;i++)
+		{
+			if (!deb_dcache_buff[i]) continue;
+			if ((l<0)||(deb_dcache_used[i]<deb_dcache_used[l])) l=i;
+		}
+
+		deb_dcache_drop(l);
+	}
+
+	deb_dcache_buff[l]=av_malloc(n+1);
+	if (!deb_dcache_buff[l]) return(0);
+
+	p=deb_dcache_buff[l];
+
+	for (j=pp+1;j<deb_filenamecnt;j++)
+	{
+		i=deb_row(j);
+		if (deb_filenamebuff_parent[i]!=slot) break;
+		if (deb_getfirstchar(deb_filenamebuff[i])=='|') continue;
+
+		if (deb_filenamebuff[i][m]=='<') p[0]='0';
+		else p[0]='1';
+
+		memset(p+1,0,6);
+		strcpy(p+1,deb_filenamebuff_ext[i]);
+		strcpy(p+1+6,deb_filenamebuff[i]+m);
+
+		p=p+1+6+strlen(p+1+6)+1;
+	}
+
+	strcpy(deb_dcache_path[l],path);
+	deb_dcache_bytes[l]=n+1;
+	deb_dcache_cnt[l]  =k;
+	deb_dcache_len[l]  =deb_filenamebuff_len[slot];
+	deb_dcache_type[l] =deb_filenamebuff_type[slot];
+	deb_dcache_used[l] =deb_dcache_tick++;
+	deb_dcache_wd[l]   =(-1);
+	deb_dcache_mtime[l]=0;
+
+	deb_dcache_total=deb_dcache_total+n+1;
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+	if (deb_dcache_ifd>=0)
+		deb_dcache_wd[l]=inotify_add_watch(deb_dcache_ifd,path,IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|
+								     IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR);
+
+	// no watch (limit reached), check the folder time instead
+	if (deb_dcache_wd[l]<0)
+	{
+		if (stat64(path,&info)==0) deb_dcache_mtime[l]=info.st_mtime;
+	}
+#else
+	if (stat(path,&info)==0) deb_dcache_mtime[l]=info.st_mtime;
+#endif
+
+	return(0);
+}
+
+// put a cached listing under folder row pp, -1 if there is none
+static int deb_dcache_get(char *path,int pp)
+{
+	int   i,j,k,l,n,slot;
+	char *p;
+#if !defined(_WIN32) && !defined(__APPLE__)
+	struct stat64 info;
+#else
+	struct stat   info;
+#endif
+
+	if (pp<0) return(-1);
+	if (pp>=deb_filenamecnt) return(-1);
+
+	deb_dcache_notify();
+
+	l=(-1);
+	for (i=0;i<DEB_DCACHE_NUM;i++)
+	{
+		if ((deb_dcache_buff[i])&&(strcmp(deb_dcache_path[i],path)==0))
+		{
+			l=i;
+			break;
+		}
+	}
+
+	if (l<0) return(-1);
+
+	if (deb_dcache_wd[l]<0)
+	{
+#if !defined(_WIN32) && !defined(__APPLE__)
+		if ((stat64(path,&info)!=0)||(info.st_mtime!=deb_dcache_mtime[l]))
+#else
+		if ((stat(path,&info)!=0)||(info.st_mtime!=deb_dcache_mtime[l]))
+#endif
+		{
+			deb_dcache_drop(l);
+			return(-1);
+		}
+	}
+
+	deb_dcache_used[l]=deb_dcache_tick++;
+
+	slot=deb_row(pp);
+
+	m207_s1[0]=0;
+
+	j=deb_get_space(deb_filenamebuff[slot]);
+	for (k=0;k<j;k++)
+	{
+		m207_s1[k+0]=' ';
+		m207_s1[k+1]=0;
+	}
+
+	strcat(m207_s1,"  ");
+
+	p=deb_dcache_buff[l];
+	n=0;
+
+	for (i=0;i<deb_dcache_cnt[l];i++)
+	{
+		if (strlen(m207_s1)+strlen(p+1+6)<1000)
+		{
+			k=deb_row_insert(pp+1+n);
+			if (k<0) break;
+
+			strcpy(deb_filenamebuff[k],m207_s1);
+			strcat(deb_filenamebuff[k],p+1+6);
+
+			strcpy(deb_filenamebuff_ext[k],p+1);
+
+			if (p[0]=='0') deb_filenamebuffpp[k]=2;
+			else deb_filenamebuffpp[k]=1;
+
+			deb_row_set_name(k,slot);
+
+			n++;
+		}
+
+		p=p+1+6+strlen(p+1+6)+1;
+	}
+
+	if (n==0)
+	{
+		k=deb_row_insert(pp+1);
+		if (k<0) return(0);
+
+		strcpy(deb_filenamebuff[k],m207_s1);
+		strcat(deb_filenamebuff[k],"|Empty Fold|");
+
+		strcpy(deb_filenamebuff_ext[k],"    ");
+		strcpy(deb_filenamebuff_size[k],"      ");
+		strcpy(deb_filenamebuff_date[k],"                   ");
+
+		deb_row_set_name(k,slot);
+
+		n=1;
+	}
+
+	deb_filenamebuff_len[slot] =deb_dcache_len[l];
+	deb_filenamebuff_type[slot]=deb_dcache_type[l];
+
+	if (pp<deb_filenameplay) deb_filenameplay=deb_filenameplay+n;
+
+	return(0);
+}
+
+// daipozhi modified for media library ==========================================
+
+static int deb_lib_unmap(DebLibIndex *lib)
+{
+#if HAVE_MMAP
+	if (lib->base) munmap(lib->base,lib->size);
+#else
+	av_free(lib->base);
+#endif
+
+	memset(lib,0,sizeof(DebLibIndex));
+
+	return(0);
+}
+
+// map an index file and check it, -1 if there is none or it is broken
+static int deb_lib_map(DebLibIndex *lib,char *fn)
+{
+	int         fh,i;
+	struct stat info;
+	int64_t     n;
+	DebLibRec  *r;
+
+	memset(lib,0,sizeof(DebLibIndex));
+
+	fh=open(fn,O_RDONLY);
+	if (fh<0) return(-1);
+
+	if ((fstat(fh,&info)!=0)||(info.st_size<(int)sizeof(DebLibHead)))
+	{
+		close(fh);
+		return(-1);
+	}
+
+	lib->size=info.st_size;
+
+#if HAVE_MMAP
+	lib->base=mmap(NULL,lib->size,PROT_READ,MAP_SHARED,fh,0);
+	if (lib->base==MAP_FAILED) lib->base=NULL;
+#else
+	lib->base=av_malloc(lib->size);
+	if ((lib->base)&&(read(fh,lib->base,lib->size)!=lib->size)) av_freep(&lib->base);
+#endif
+
+	close(fh);
+
+	if (!lib->base) return(-1);
+
+	lib->head=(DebLibHead *)lib->base;
+
+	n=sizeof(DebLibHead)+(int64_t)lib->head->rec_cnt*sizeof(DebLibRec)+(int64_t)lib->head->fold_cnt*sizeof(int32_t)+lib->head->str_size;
+
+	if ((memcmp(lib->head->magic,"PPIX",4)!=0)||(lib->head->version!=DEB_LIB_VERSION)||
+	    (lib->head->rec_cnt<0)||(lib->head->fold_cnt<0)||(lib->head->str_size<1)||(n!=lib->size))
+	{
+		deb_lib_unmap(lib);
+		return(-1);
+	}
+
+	lib->rec =(DebLibRec *)(lib->base+sizeof(DebLibHead));
+	lib->fold=(int32_t *)(lib->rec+lib->head->rec_cnt);
+	lib->str =(char *)(lib->fold+lib->head->fold_cnt);
+
+	// the mapping is read only, a stale or cut index is refused, not patched
+	if ((lib->str[lib->head->str_size-1]!=0)||(lib->head->fold_cnt>lib->head->rec_cnt)||
+	    (lib->head->root_cnt<0)||(lib->head->root_cnt>lib->head->rec_cnt))
+	{
+		deb_lib_unmap(lib);
+		return(-1);
+	}
+
+	for (i=0;i<lib->head->rec_cnt;i++)
+	{
+		r=&lib->rec[i];
+
+		if ((r->name>=lib->head->str_size)||(r->key>=lib->head->str_size)||(r->path>=lib->head->str_size)||
+		    (r->parent<(-1))||(r->parent>=lib->head->rec_cnt)||(r->child_cnt<(-2))||
+		    ((r->child_cnt>0)&&((r->child<0)||((int64_t)r->child+r->child_cnt>lib->head->rec_cnt))))
+		{
+			deb_lib_unmap(lib);
+			return(-1);
+		}
+	}
+
+	for (i=0;i<lib->head->fold_cnt;i++)
+	{
+		if ((lib->fold[i]<0)||(lib->fold[i]>=lib->head->rec_cnt))
+		{
+			deb_lib_unmap(lib);
+			return(-1);
+		}
+	}
+
+	return(0);
+}
+
+// folder record of a path, -1 if it is not in the index
+static int deb_lib_find(DebLibIndex *lib,char *path)
+{
+	int l,m,k,i;
+
+	if (!lib->base) return(-1);
+
+	l=0;
+	m=lib->head->fold_cnt;
+
+	while (l<m)
+	{
+		k=(l+m)/2;
+		i=strcmp(lib->str+lib->rec[lib->fold[k]].path,path);
+		if (i==0) return(lib->fold[k]);
+		if (i<0) l=k+1;
+		else m=k;
+	}
+
+	return(-1);
+}
+
+static char m208_s1[3000];
+static char m208_s2[3000];
+
+// put the indexed listing under folder row pp, -1 if the folder is not indexed
+static int deb_lib_get(char *path,int pp)
+{
+	int        i,j,k,n,f,slot,len;
+	char       type;
+	DebLibRec *r;
+
+	if (pp<0) return(-1);
+	if (pp>=deb_filenamecnt) return(-1);
+
+	f=deb_lib_find(&deb_lib,path);
+	if (f<0) return(-1);
+	if (deb_lib.rec[f].child_cnt<0) return(-1);
+
+	slot=deb_row(pp);
+
+	m208_s1[0]=0;
+
+	j=deb_get_space(deb_filenamebuff[slot]);
+	for (k=0;k<j;k++)
+	{
+		m208_s1[k+0]=' ';
+		m208_s1[k+1]=0;
+	}
+
+	strcat(m208_s1,"  ");
+
+	n=0;
+	len=0;
+	type=0;
+
+	for (i=0;i<deb_lib.rec[f].child_cnt;i++)
+	{
+		r=&deb_lib.rec[deb_lib.rec[f].child+i];
+
+		if (strlen(m208_s1)+strlen(deb_lib.str+r->name)+2>=1000) continue;
+
+		k=deb_row_insert(pp+1+n);
+		if (k<0) break;
+
+		strcpy(deb_filenamebuff[k],m208_s1);
+
+		if (r->type==0)
+		{
+			strcat(deb_filenamebuff[k],"<");
+			strcat(deb_filenamebuff[k],deb_lib.str+r->name);
+			strcat(deb_filenamebuff[k],">");
+
+			deb_filenamebuffpp[k]=2;
+		}
+		else
+		{
+			strcat(deb_filenamebuff[k],deb_lib.str+r->name);
+
+			deb_filenameext(deb_lib.str+r->name,m208_s2);
+			if (((int)strlen(m208_s2)>4)||((int)strlen(m208_s2)<=0))
+			{
+				strcpy(deb_filenamebuff_ext[k],"    ");
+			}
+			else
+			{
+				strcat(m208_s2,"    ");
+				m208_s2[4]=0;
+				str_lower_string(m208_s2,deb_filenamebuff_ext[k]);
+			}
+
+			deb_size_string(r->size,deb_filenamebuff_size[k]);
+			deb_date_string((time_t)r->mtime,deb_filenamebuff_date[k]);
+
+			deb_filenamebuffpp[k]=1;
+
+			// the key is the gb18030 name, so its length is the screen width
+			j=(int)strlen(deb_lib.str+r->key)-1;
+			if (len<j) len=j;
+			type=1;
+		}
+
+		deb_row_set_name(k,slot);
+
+		n++;
+	}
+
+	if (n==0)
+	{
+		k=deb_row_insert(pp+1);
+		if (k<0) return(0);
+
+		strcpy(deb_filenamebuff[k],m208_s1);
+		strcat(deb_filenamebuff[k],"|Empty Fold|");
+
+		strcpy(deb_filenamebuff_ext[k],"    ");
+		strcpy(deb_filenamebuff_size[k],"      ");
+		strcpy(deb_filenamebuff_date[k],"                   ");
+
+		deb_row_set_name(k,slot);
+
+		len=12;
+		n=1;
+	}
+
+	deb_filenamebuff_len[slot] =len;
+	deb_filenamebuff_type[slot]=type;
+
+	if (pp<deb_filenameplay) deb_filenameplay=deb_filenameplay+n;
+
+	return(0);
+}
+
+// crawler side, only used by deb_lib_thread()
+
+static DebLibRec *m209_rec;
+static int        m209_rec_cnt;
+static int        m209_rec_max;
+static char      *m209_str;
+static int64_t    m209_str_size;
+static int64_t    m209_str_max;
+static char       m209_path[3000];
+static char       m209_s1[3000];
+static char       m209_s2[3000];
+static char       m209_s3[3000];
+
+static int deb_lib_add_str(char *str)
+{
+	int64_t n,p1;
+	char   *p;
+
+	n=strlen(str)+1;
+
+	if (m209_str_size+n>m209_str_max)
+	{
+		p=av_realloc(m209_str,(m209_str_size+n)*2);
+		if (!p) return(-1);
+		m209_str=p;
+		m209_str_max=(m209_str_size+n)*2;
+	}
+
+	p1=m209_str_size;
+	memcpy(m209_str+p1,str,n);
+	m209_str_size=m209_str_size+n;
+
+	return((int)p1);
+}
+
+static int deb_lib_add_rec(void)
+{
+	DebLibRec *p;
+
+	if (m209_rec_cnt>=m209_rec_max)
+	{
+		p=av_realloc(m209_rec,(m209_rec_max*2+1024)*sizeof(DebLibRec));
+		if (!p) return(-1);
+		m209_rec=p;
+		m209_rec_max=m209_rec_max*2+1024;
+	}
+
+	memset(&m209_rec[m209_rec_cnt],0,sizeof(DebLibRec));
+	m209_rec[m209_rec_cnt].parent=(-1);
+	m209_rec[m209_rec_cnt].child=(-1);
+	m209_rec[m209_rec_cnt].child_cnt=(-1);
+
+	m209_rec_cnt++;
+
+	return(m209_rec_cnt-1);
+}
+
+// record with name, sort key and (for folders) full path
+static int deb_lib_add_entry(int parent,char *ppath,char *name,int type,int64_t size,int64_t mtime)
+{
+	int i,j;
+
+	i=deb_lib_add_rec();
+	if (i<0) return(-1);
+
+	m209_rec[i].parent=parent;
+	m209_rec[i].type  =type;
+	m209_rec[i].size  =size;
+	m209_rec[i].mtime =mtime;
+
+	j=deb_lib_add_str(name);
+	if (j<0) return(-1);
+	m209_rec[i].name=j;
+
+	// same order as search_node(), folders first
+	if (type==0)
+	{
+		strcpy(m209_s1,"<");
+		av_strlcat(m209_s1,name,3000);
+		av_strlcat(m209_s1,">",3000);
+	}
+	else av_strlcpy(m209_s1,name,3000);
+
+	str_lower_string(m209_s1,m209_s2);
+
+	m209_s3[0]=(char)('0'+type);
+	memset(m209_s3+1,0,3000-1);
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+	deb_utf8_to_gb18030(m209_s2,m209_s3+1,3000-2);
+#else
+	av_strlcpy(m209_s3+1,m209_s2,3000-1);
+#endif
+
+	j=deb_lib_add_str(m209_s3);
+	if (j<0) return(-1);
+	m209_rec[i].key=j;
+
+	if (type==0)
+	{
+		av_strlcpy(m209_s1,ppath,3000);
+		if ((strlen(m209_s1)>0)&&(m209_s1[strlen(m209_s1)-1]!='/')) av_strlcat(m209_s1,"/",3000);
+		av_strlcat(m209_s1,name,3000);
+
+		j=deb_lib_add_str(m209_s1);
+		if (j<0) return(-1);
+		m209_rec[i].path=j;
+	}
+
+	return(0);
+}
+
+static int deb_lib_cmp_key(const void *p1,const void *p2)
+{
+	return(strcmp(m209_str+((DebLibRec *)p1)->key,m209_str+((DebLibRec *)p2)->key));
+}
+
+static int deb_lib_cmp_path(const void *p1,const void *p2)
+{
+	return(strcmp(m209_str+m209_rec[*(int32_t *)p1].path,m209_str+m209_rec[*(int32_t *)p2].path));
+}
+
+// read folder f, reusing the old listing when the folder time did not change
+static int deb_lib_folder(DebLibIndex *old,int f)
+{
+	DIR           *dirp;
+	struct dirent *entry;
+	int            i,o,start,type;
+#if !defined(_WIN32) && !defined(__APPLE__)
+	struct stat64  info;
+#else
+	struct stat    info;
+#endif
+
+	av_strlcpy(m209_path,m209_str+m209_rec[f].path,3000);
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+	if (stat64(m209_path,&info)!=0) return(-1);
+#else
+	if (stat(m209_path,&info)!=0) return(-1);
+#endif
+
+	m209_rec[f].mtime=info.st_mtime;
+
+	start=m209_rec_cnt;
+
+	o=deb_lib_find(old,m209_path);
+
+	if ((o>=0)&&(old->rec[o].mtime==info.st_mtime)&&(old->rec[o].child_cnt>=0))
+	{
+		for (i=0;i<old->rec[o].child_cnt;i++)
+		{
+			DebLibRec *r=&old->rec[old->rec[o].child+i];
+
+			if (deb_lib_add_entry(f,m209_path,old->str+r->name,r->type,r->size,r->mtime)!=0) return(-1);
+		}
+	}
+	else
+	{
+		dirp=opendir(m209_path);
+		if (!dirp) return(-1);
+
+		while ((entry=readdir(dirp)))
+		{
+			if (strcmp(entry->d_name,".") ==0) continue;
+			if (strcmp(entry->d_name,"..")==0) continue;
+
+			if (deb_str_has_null(entry->d_name,1000)!=1) continue;
+			if (strlen(entry->d_name)>=1000-2) continue;
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+			if (fstatat64(dirfd(dirp),entry->d_name,&info,0)!=0) continue;
+#elif !defined(_WIN32)
+			if (fstatat(dirfd(dirp),entry->d_name,&info,0)!=0) continue;
+#else
+			av_strlcpy(m209_s1,m209_path,3000);
+			av_strlcat(m209_s1,"/",3000);
+			av_strlcat(m209_s1,entry->d_name,3000);
+			if (stat(m209_s1,&info)!=0) continue;
+#endif
+
+			if (S_ISDIR(info.st_mode)) type=0;
+			else type=1;
+
+			if (deb_lib_add_entry(f,m209_path,entry->d_name,type,info.st_size,info.st_mtime)!=0)
+			{
+				closedir(dirp);
+				return(-1);
+			}
+		}
+
+		closedir(dirp);
+
+		qsort(&m209_rec[start],m209_rec_cnt-start,sizeof(DebLibRec),deb_lib_cmp_key);
+	}
+
+	m209_rec[f].child=start;
+	m209_rec[f].child_cnt=m209_rec_cnt-start;
+
+	// links to folders are listed but not followed
+#if !defined(_WIN32)
+	for (i=start;i<m209_rec_cnt;i++)
+	{
+		struct stat info2;
+
+		if (m209_rec[i].type!=0) continue;
+		if ((lstat(m209_str+m209_rec[i].path,&info2)==0)&&(S_ISLNK(info2.st_mode))) m209_rec[i].child_cnt=(-2);
+	}
+#endif
+
+	return(0);
+}
+
+// crawl all roots into a new index file
+static int deb_lib_crawl(void)
+{
+	FILE       *fp;
+	DebLibIndex old;
+	DebLibHead  head;
+	int32_t    *fold;
+	int         i,n,q,root_cnt;
+	char       *p;
+
+	m209_rec_cnt=0;
+	m209_str_size=0;
+
+	if (deb_lib_add_str("")<0) return(-1);
+
+	snprintf(m209_s1,3000,"%s/library/roots.txt",deb_lib_home);
+
+	fp=fopen(m209_s1,"r");
+	if (!fp) return(-1);
+
+	while (fgets(m209_s2,3000,fp))
+	{
+		n=(int)strlen(m209_s2);
+		while ((n>0)&&((m209_s2[n-1]=='\n')||(m209_s2[n-1]=='\r')||(m209_s2[n-1]==' '))) n--;
+		while ((n>1)&&(m209_s2[n-1]=='/')) n--;
+		m209_s2[n]=0;
+
+		if (n<=0) continue;
+		if (m209_s2[0]=='#') continue;
+
+		i=deb_lib_add_rec();
+		if (i<0) break;
+
+		m209_rec[i].type=0;
+		m209_rec[i].name=deb_lib_add_str(m209_s2);
+		m209_rec[i].key =m209_rec[i].name;
+		m209_rec[i].path=m209_rec[i].name;
+	}
+
+	fclose(fp);
+
+	root_cnt=m209_rec_cnt;
+
+	snprintf(m209_s1,3000,"%s/library/index.data",deb_lib_home);
+	deb_lib_map(&old,m209_s1);
+
+	// breadth first, so every folder's children stay together
+	for (q=0;q<m209_rec_cnt;q++)
+	{
+		if (m209_rec[q].type!=0) continue;
+		if (m209_rec[q].child_cnt==(-2)) continue;
+
+		deb_lib_folder(&old,q);
+	}
+
+	deb_lib_unmap(&old);
+
+	n=0;
+	for (i=0;i<m209_rec_cnt;i++) if (m209_rec[i].type==0) n++;
+
+	fold=av_malloc((n+1)*sizeof(int32_t));
+	if (!fold) return(-1);
+
+	n=0;
+	for (i=0;i<m209_rec_cnt;i++) if (m209_rec[i].type==0) fold[n++]=i;
+
+	qsort(fold,n,sizeof(int32_t),deb_lib_cmp_path);
+
+	memset(&head,0,sizeof(head));
+	memcpy(head.magic,"PPIX",4);
+	head.version =DEB_LIB_VERSION;
+	head.rec_cnt =m209_rec_cnt;
+	head.fold_cnt=n;
+	head.root_cnt=root_cnt;
+	head.str_size=m209_str_size;
+
+	snprintf(m209_s1,3000,"%s/library/index.data.tmp",deb_lib_home);
+
+	fp=fopen(m209_s1,"wb");
+	if (!fp)
+	{
+		av_free(fold);
+		return(-1);
+	}
+
+	i=0;
+	if (fwrite(&head,sizeof(head),1,fp)!=1) i=(-1);
+	if ((m209_rec_cnt>0)&&(fwrite(m209_rec,sizeof(DebLibRec),m209_rec_cnt,fp)!=(size_t)m209_rec_cnt)) i=(-1);
+	if ((n>0)&&(fwrite(fold,sizeof(int32_t),n,fp)!=(size_t)n)) i=(-1);
+	if (fwrite(m209_str,1,m209_str_size,fp)!=(size_t)m209_str_size) i=(-1);
+	if (fclose(fp)!=0) i=(-1);
+
+	av_free(fold);
+
+	if (i!=0) return(-1);
+
+	snprintf(m209_s2,3000,"%s/library/index.data",deb_lib_home);
+
+	p=m209_s1;
+#if defined(_WIN32)
+	remove(m209_s2);
+#endif
+	if (rename(p,m209_s2)!=0) return(-1);
+
+	return(0);
+}
+
+static int deb_lib_thread(void *arg)
+{
+	SDL_Event event;
+	int       i;
+
+	while (1)
+	{
+		if (deb_lib_crawl()==0)
+		{
+			event.type = FF_LIB_EVENT;
+			event.user.data1 = NULL;
+			deb_push_event(&event);
+		}
+
+		// look again later, only changed folders are read
+		for (i=0;i<DEB_LIB_RESCAN;i++) SDL_Delay(1000);
+	}
+
+	return(0);
+}
+
+static int deb_lib_init(void)
+{
+	getcwd(deb_lib_home,3000);
+
+	snprintf(m208_s1,3000,"%s/library/index.data",deb_lib_home);
+	deb_lib_map(&deb_lib,m208_s1);
+	deb_lib_serial++;
+
+	snprintf(m208_s1,3000,"%s/library/roots.txt",deb_lib_home);
+	if (access(m208_s1,R_OK)!=0) return(0);
+
+	deb_lib_tid=SDL_CreateThread(deb_lib_thread,NULL);
+	if (!deb_lib_tid)
+	{
+		av_log(NULL, AV_LOG_ERROR, "SDL_CreateThread(): %s\n", SDL_GetError());
+		return(-1);
+	}
+
+	return(0);
+}
+
+// the crawler wrote a new index
+static int deb_lib_reload(void)
+{
+	// the results of the old mapping must not be read through the new one
+	deb_search_lib_drop();
+
+	deb_lib_unmap(&deb_lib);
+
+	snprintf(m208_s1,3000,"%s/library/index.data",deb_lib_home);
+	deb_lib_map(&deb_lib,m208_s1);
+	deb_lib_serial++;
+
+	return(0);
+}
+
+// daipozhi modified for media probe ============================================
+
+static unsigned int deb_probe_hash_str(char *path)
+{
+	unsigned int h;
+
+	h=0;
+	while (*path)
+	{
+		h=h*31+(unsigned char)(*path);
+		path++;
+	}
+
+	return(h&(DEB_PROBE_HASH-1));
+}
+
+// cache lookup, called with deb_probe_mutex held, -1 if not there
+static int deb_probe_cache_find(char *path,int64_t size,int64_t mtime,int64_t *dur)
+{
+	int i;
+
+	i=deb_probe_chash[deb_probe_hash_str(path)];
+
+	while (i>=0)
+	{
+		if ((deb_probe_csize[i]==size)&&(deb_probe_cmtime[i]==mtime)&&(strcmp(deb_probe_cpath[i],path)==0))
+		{
+			*dur=deb_probe_cdur[i];
+			return(0);
+		}
+
+		i=deb_probe_cnext[i];
+	}
+
+	return(-1);
+}
+
+// cache insert, called with deb_probe_mutex held
+static int deb_probe_cache_put(char *path,int64_t size,int64_t mtime,int64_t dur)
+{
+	int   i,h,n;
+	void *p;
+
+	h=deb_probe_hash_str(path);
+
+	i=deb_probe_chash[h];
+
+	while (i>=0)
+	{
+		if (strcmp(deb_probe_cpath[i],path)==0) break;
+		i=deb_probe_cnext[i];
+	}
+
+	if (i<0)
+	{
+		if (deb_probe_ccnt>=deb_probe_cmax)
+		{
+			n=deb_probe_cmax*2+1024;
+
+			p=av_realloc(deb_probe_cpath,n*sizeof(char *));
+			if (!p) return(-1);
+			deb_probe_cpath=p;
+
+			p=av_realloc(deb_probe_csize,n*sizeof(int64_t));
+			if (!p) return(-1);
+			deb_probe_csize=p;
+
+			p=av_realloc(deb_probe_cmtime,n*sizeof(int64_t));
+			if (!p) return(-1);
+			deb_probe_cmtime=p;
+
+			p=av_realloc(deb_probe_cdur,n*sizeof(int64_t));
+			if (!p) return(-1);
+			deb_probe_cdur=p;
+
+			p=av_realloc(deb_probe_cnext,n*sizeof(int));
+			if (!p) return(-1);
+			deb_probe_cnext=p;
+
+			deb_probe_cmax=n;
+		}
+
+		i=deb_probe_ccnt;
+
+		deb_probe_cpath[i]=av_strdup(path);
+		if (!deb_probe_cpath[i]) return(-1);
+
+		deb_probe_cnext[i]=deb_probe_chash[h];
+		deb_probe_chash[h]=i;
+
+		deb_probe_ccnt++;
+	}
+
+	deb_probe_csize[i] =size;
+	deb_probe_cmtime[i]=mtime;
+	deb_probe_cdur[i]  =dur;
+
+	return(0);
+}
+
+// open the file with a small probe size, duration in seconds or -1
+static int64_t deb_probe_file(char *path)
+{
+	AVFormatContext *ic=NULL;
+	AVDictionary    *opts=NULL;
+	int64_t          dur;
+
+	av_dict_set(&opts,"probesize","65536",0);
+	av_dict_set(&opts,"analyzeduration","1000000",0);
+
+	if (avformat_open_input(&ic,path,NULL,&opts)<0)
+	{
+		av_dict_free(&opts);
+		return(-1);
+	}
+
+	av_dict_free(&opts);
+
+	// most containers have it in the header
+	if (ic->duration==AV_NOPTS_VALUE) avformat_find_stream_info(ic,NULL);
+
+	if ((ic->duration==AV_NOPTS_VALUE)||(ic->duration<0)) dur=(-1);
+	else dur=(ic->duration+AV_TIME_BASE/2)/AV_TIME_BASE;
+
+	avformat_close_input(&ic);
+
+	return(dur);
+}
+
+static int deb_probe_thread(void *arg)
+{
+	SDL_Event event;
+	int       slot;
+	unsigned  stamp;
+	int64_t   dur;
+	char     *path;
+#if !defined(_WIN32) && !defined(__APPLE__)
+	struct stat64 info;
+#else
+	struct stat   info;
+#endif
+
+	path=av_malloc(3000);
+	if (!path) return(-1);
+
+	while (1)
+	{
+		SDL_LockMutex(deb_probe_mutex);
+
+		while (deb_probe_jcnt<=0) SDL_CondWait(deb_probe_cond,deb_probe_mutex);
+
+		// first queued, first taken; visible rows are queued first
+		slot =deb_probe_jslot[0];
+		stamp=deb_probe_jstamp[0];
+		strcpy(path,deb_probe_jpath[0]);
+
+		deb_probe_jcnt--;
+		if (deb_probe_jcnt>0)
+		{
+			memmove(&deb_probe_jslot[0] ,&deb_probe_jslot[1] ,deb_probe_jcnt*sizeof(int));
+			memmove(&deb_probe_jstamp[0],&deb_probe_jstamp[1],deb_probe_jcnt*sizeof(unsigned));
+			memmove(&deb_probe_jpath[0] ,&deb_probe_jpath[1] ,deb_probe_jcnt*3000);
+		}
+
+		SDL_UnlockMutex(deb_probe_mutex);
+
+		dur=(-1);
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+		if (stat64(path,&info)==0)
+#else
+		if (stat(path,&info)==0)
+#endif
+		{
+			SDL_LockMutex(deb_probe_mutex);
+			if (deb_probe_cache_find(path,info.st_size,info.st_mtime,&dur)!=0)
+			{
+				SDL_UnlockMutex(deb_probe_mutex);
+
+				dur=deb_probe_file(path);
+
+				SDL_LockMutex(deb_probe_mutex);
+
+				if (deb_probe_cache_put(path,info.st_size,info.st_mtime,dur)==0)
+				{
+					if ((deb_probe_fp)&&(!strchr(path,'\n')))
+					{
+						fprintf(deb_probe_fp,"%lld %lld %lld %s\n",(long long)info.st_size,(long long)info.st_mtime,(long long)dur,path);
+						fflush(deb_probe_fp);
+					}
+				}
+			}
+			SDL_UnlockMutex(deb_probe_mutex);
+		}
+
+		SDL_LockMutex(deb_probe_mutex);
+
+		while (deb_probe_rcnt>=DEB_PROBE_QUEUE) SDL_CondWait(deb_probe_cond2,deb_probe_mutex);
+
+		deb_probe_rslot[deb_probe_rcnt] =slot;
+		deb_probe_rstamp[deb_probe_rcnt]=stamp;
+		deb_probe_rdur[deb_probe_rcnt]  =dur;
+		deb_probe_rcnt++;
+
+		// one event for a group of results
+		if (deb_probe_posted==0)
+		{
+			deb_probe_posted=1;
+
+			event.type = FF_PROBE_EVENT;
+			event.user.data1 = NULL;
+			deb_push_event(&event);
+		}
+
+		SDL_UnlockMutex(deb_probe_mutex);
+	}
+
+	av_free(path);
+
+	return(0);
+}
+
+static int deb_probe_init(void)
+{
+	FILE     *fp;
+	char     *p;
+	long long n1,n2,n3;
+	int       i,n;
+
+	for (i=0;i<DEB_PROBE_HASH;i++) deb_probe_chash[i]=(-1);
+
+	deb_probe_mutex=SDL_CreateMutex();
+	deb_probe_cond =SDL_CreateCond();
+	deb_probe_cond2=SDL_CreateCond();
+
+	if ((!deb_probe_mutex)||(!deb_probe_cond)||(!deb_probe_cond2)) return(-1);
+
+	// later lines replace earlier ones for the same path
+	snprintf(m208_s1,3000,"%s/library/probe.data",deb_lib_home);
+
+	fp=fopen(m208_s1,"r");
+	if (fp)
+	{
+		while (fgets(m208_s2,3000,fp))
+		{
+			n=(int)strlen(m208_s2);
+			if ((n<=0)||(m208_s2[n-1]!='\n')) continue;
+			m208_s2[n-1]=0;
+
+			if (sscanf(m208_s2,"%lld %lld %lld ",&n1,&n2,&n3)!=3) continue;
+
+			p=m208_s2;
+			for (i=0;i<3;i++)
+			{
+				p=strchr(p,' ');
+				if (!p) break;
+				p++;
+			}
+			if ((!p)||(p[0]==0)) continue;
+
+			deb_probe_cache_put(p,n1,n2,n3);
+		}
+
+		fclose(fp);
+	}
+
+	deb_probe_fp=fopen(m208_s1,"a");
+
+	for (i=0;i<DEB_PROBE_THREADS;i++)
+	{
+		deb_probe_tid[i]=SDL_CreateThread(deb_probe_thread,NULL);
+		if (!deb_probe_tid[i])
+		{
+			av_log(NULL, AV_LOG_ERROR, "SDL_CreateThread(): %s\n", SDL_GetError());
+			return(-1);
+		}
+	}
+
+	return(0);
+}
+
+static char m210_s1[3000];
+
+// queue row pp for probing if it is a media file not asked for yet, -1 if the queue is full
+static int deb_probe_row(int pp)
+{
+	int i,n;
+
+	if (pp<0) return(0);
+	if (pp>=deb_filenamecnt) return(0);
+
+	i=deb_row(pp);
+
+	if (deb_filenamebuffpp[i]!=1) return(0);
+	if (deb_filenamebuff_probe[i]!=0) return(0);
+
+	strcpy(m210_s1,deb_filenamebuff_ext[i]);
+
+	n=(int)strlen(m210_s1);
+	while ((n>0)&&(m210_s1[n-1]==' ')) n--;
+	m210_s1[n]=0;
+
+	if (deb_supported_formats(m210_s1)!=1)
+	{
+		deb_filenamebuff_probe[i]=2;
+		deb_filenamebuff_dur[i][0]=0;
+		return(0);
+	}
+
+	if (deb_probe_jcnt>=DEB_PROBE_QUEUE) return(-1);
+
+	deb_get_path_to(pp,m210_s1);
+	if (m210_s1[0]==0) return(0);
+
+	deb_probe_jslot[deb_probe_jcnt] =i;
+	deb_probe_jstamp[deb_probe_jcnt]=deb_filenamebuff_stamp[i];
+	strcpy(deb_probe_jpath[deb_probe_jcnt],m210_s1);
+	deb_probe_jcnt++;
+
+	deb_filenamebuff_probe[i]=1;
+
+	return(0);
+}
+
+// queue the rows on the screen, then one screen below and above
+static int deb_probe_view(int h)
+{
+	int i,n;
+
+	if (!deb_probe_mutex) return(0);
+
+	n=h-4;
+	if (n<=0) return(0);
+
+	SDL_LockMutex(deb_probe_mutex);
+
+	// rows that were waiting for an old view go back to not asked
+	for (i=0;i<deb_probe_jcnt;i++)
+	{
+		if (deb_filenamebuff_stamp[deb_probe_jslot[i]]==deb_probe_jstamp[i]) deb_filenamebuff_probe[deb_probe_jslot[i]]=0;
+	}
+
+	deb_probe_jcnt=0;
+
+	for (i=deb_filenamebuff_n;i<deb_filenamebuff_n+n;i++)
+	{
+		if (deb_probe_row(i)!=0) break;
+	}
+
+	for (i=deb_filenamebuff_n+n;i<deb_filenamebuff_n+n*2;i++)
+	{
+		if (deb_probe_row(i)!=0) break;
+	}
+
+	for (i=deb_filenamebuff_n-1;i>=deb_filenamebuff_n-n;i--)
+	{
+		if (deb_probe_row(i)!=0) break;
+	}
+
+	if (deb_probe_jcnt>0) SDL_CondBroadcast(deb_probe_cond);
+
+	SDL_UnlockMutex(deb_probe_mutex);
+
+	return(0);
+}
+
+// put the finished results into their rows
+static int deb_probe_batch(VideoState *is)
+{
+	int i,k,n;
+
+	SDL_LockMutex(deb_probe_mutex);
+
+	n=0;
+
+	for (i=0;i<deb_probe_rcnt;i++)
+	{
+		k=deb_probe_rslot[i];
+
+		if (deb_filenamebuff_stamp[k]!=deb_probe_rstamp[i]) continue;
+		if (deb_filenamebuff_probe[k]!=1) continue;
+
+		deb_dur_string(deb_probe_rdur[i],deb_filenamebuff_dur[k]);
+		deb_filenamebuff_probe[k]=2;
+
+		n++;
+	}
+
+	deb_probe_rcnt=0;
+	deb_probe_posted=0;
+
+	SDL_CondBroadcast(deb_probe_cond2);
+	SDL_UnlockMutex(deb_probe_mutex);
+
+	if (n>0) deb_disp_dir(is);
+
+	return(0);
+}
+
+// duration column, h:mm:ss in 8 chars
+static int deb_dur_string(int64_t dur,char *buffer)
+{
+	if (dur<0)
+	{
+		strcpy(buffer,"--:--:--");
+		return(0);
+	}
+
+	if (dur>=100*3600) dur=100*3600-1;
+
+	snprintf(buffer,9,"%2d:%02d:%02d",(int)(dur/3600),(int)((dur/60)%60),(int)(dur%60));
+
+	return(0);
+}
+
+// daipozhi modified for search =================================================
+
+static unsigned int deb_search_tri_hash(unsigned char *p)
+{
+	unsigned int h;
+
+	h=((unsigned int)p[0]<<16)|((unsigned int)p[1]<<8)|(unsigned int)p[2];
+
+	return(((h*2654435761u)>>16)&(DEB_SEARCH_TRI-1));
+}
+
+static int deb_search_tri_clear(DebSearchTri *t)
+{
+	int i;
+
+	for (i=0;i<DEB_SEARCH_TRI;i++) t->cnt[i]=0;
+
+	t->total=0;
+
+	return(0);
+}
+
+// add id to the list of every three bytes of key
+static int deb_search_tri_add(DebSearchTri *t,char *key,int id)
+{
+	int   i,h,n,len;
+	void *p;
+
+	len=(int)strlen(key);
+
+	for (i=0;i+3<=len;i++)
+	{
+		h=deb_search_tri_hash((unsigned char *)key+i);
+
+		if (t->cnt[h]>=t->max[h])
+		{
+			n=t->max[h]*2+16;
+			p=av_realloc(t->post[h],n*sizeof(int));
+			if (!p) return(-1);
+			t->post[h]=p;
+			t->max[h]=n;
+		}
+
+		t->post[h][t->cnt[h]]=id;
+		t->cnt[h]++;
+		t->total++;
+	}
+
+	return(0);
+}
+
+// shortest list among the three bytes groups of the query
+static int deb_search_tri_best(DebSearchTri *t,char *q)
+{
+	int i,h,m,len;
+
+	len=(int)strlen(q);
+	m=(-1);
+
+	for (i=0;i+3<=len;i++)
+	{
+		h=deb_search_tri_hash((unsigned char *)q+i);
+		if ((m<0)||(t->cnt[h]<t->cnt[m])) m=h;
+	}
+
+	return(m);
+}
+
+static char m211_s1[3000];
+static char m211_s2[3000];
+
+// index the rows and the library names added since the last call, 1 if something changed
+static int deb_search_sync(void)
+{
+	int   i,j,n,live,changed;
+	char *p;
+
+	changed=0;
+	live=0;
+
+	for (i=0;i<10000;i++)
+	{
+		if (deb_filenamebuff[i][0]==0) continue;
+		if ((deb_filenamebuffpp[i]!=1)&&(deb_filenamebuffpp[i]!=2)) continue;
+
+		live++;
+
+		if ((deb_search_rkey[i])&&(deb_search_rstamp[i]==deb_filenamebuff_stamp[i])) continue;
+
+		n=deb_filenamebuff_namelen[i];
+		if ((n<=0)||(n>=1000)) continue;
+
+		memcpy(m211_s1,deb_filenamebuff[i]+deb_filenamebuff_name[i],n);
+		m211_s1[n]=0;
+		str_lower_string(m211_s1,m211_s2);
+
+		av_freep(&deb_search_rkey[i]);
+		deb_search_rkey[i]=av_strdup(m211_s2);
+		if (!deb_search_rkey[i]) continue;
+
+		deb_search_rstamp[i]=deb_filenamebuff_stamp[i];
+
+		deb_search_tri_add(&deb_search_row,deb_search_rkey[i],i);
+		deb_search_radd++;
+
+		changed=1;
+	}
+
+	// old slots stay in the lists until they are rebuilt
+	if (deb_search_radd>live*2+10000)
+	{
+		deb_search_tri_clear(&deb_search_row);
+		deb_search_radd=0;
+
+		for (i=0;i<10000;i++)
+		{
+			if (!deb_search_rkey[i]) continue;
+			if (deb_filenamebuff[i][0]==0) continue;
+			if (deb_search_rstamp[i]!=deb_filenamebuff_stamp[i]) continue;
+
+			deb_search_tri_add(&deb_search_row,deb_search_rkey[i],i);
+			deb_search_radd++;
+		}
+	}
+
+	if (deb_search_lserial!=deb_lib_serial)
+	{
+		deb_search_lserial=deb_lib_serial;
+
+		deb_search_tri_clear(&deb_search_lib);
+		av_freep(&deb_search_lkey);
+		av_freep(&deb_search_loff);
+		av_freep(&deb_search_lmark);
+		deb_search_lcnt=0;
+
+		changed=1;
+
+		if ((deb_lib.base)&&(deb_lib.head->rec_cnt>0))
+		{
+			n=deb_lib.head->rec_cnt;
+
+			deb_search_lkey =av_malloc(deb_lib.head->str_size+n);
+			deb_search_loff =av_malloc(n*sizeof(int));
+			deb_search_lmark=av_mallocz(n*sizeof(unsigned));
+
+			if ((!deb_search_lkey)||(!deb_search_loff)||(!deb_search_lmark))
+			{
+				av_freep(&deb_search_lkey);
+				av_freep(&deb_search_loff);
+				av_freep(&deb_search_lmark);
+				return(changed);
+			}
+
+			j=0;
+
+			for (i=0;i<n;i++)
+			{
+				p=deb_lib.str+deb_lib.rec[i].name;
+
+				deb_search_loff[i]=j;
+				str_lower_string(p,deb_search_lkey+j);
+				j=j+(int)strlen(p)+1;
+
+				// roots are full paths, their own folders are what is searched
+				if (i<deb_lib.head->root_cnt) continue;
+
+				deb_search_tri_add(&deb_search_lib,deb_search_lkey+deb_search_loff[i],i);
+			}
+
+			deb_search_lcnt=n;
+		}
+	}
+
+	return(changed);
+}
+
+static int deb_search_res_add(int id,unsigned stamp)
+{
+	int   n;
+	void *p;
+
+	if (deb_search_rescnt>=deb_search_resmax)
+	{
+		n=deb_search_resmax*2+1024;
+
+		p=av_realloc(deb_search_res,n*sizeof(int));
+		if (!p) return(-1);
+		deb_search_res=p;
+
+		p=av_realloc(deb_search_resstamp,n*sizeof(unsigned));
+		if (!p) return(-1);
+		deb_search_resstamp=p;
+
+		deb_search_resmax=n;
+	}
+
+	deb_search_res[deb_search_rescnt]=id;
+	deb_search_resstamp[deb_search_rescnt]=stamp;
+	deb_search_rescnt++;
+
+	return(0);
+}
+
+// 1 if result id still holds q
+static int deb_search_match(int id,unsigned stamp,char *q)
+{
+	if (id<DEB_SEARCH_LIB)
+	{
+		if (deb_filenamebuff[id][0]==0) return(0);
+		if (deb_filenamebuff_stamp[id]!=stamp) return(0);
+		if (!deb_search_rkey[id]) return(0);
+		if (deb_search_rstamp[id]!=stamp) return(0);
+
+		if (strstr(deb_search_rkey[id],q)) return(1);
+		else return(0);
+	}
+
+	id=id-DEB_SEARCH_LIB;
+
+	if ((!deb_lib.base)||(deb_search_lserial!=deb_lib_serial)) return(0);
+	if (id>=deb_search_lcnt) return(0);
+	if (id<deb_lib.head->root_cnt) return(0);
+
+	if (strstr(deb_search_lkey+deb_search_loff[id],q)) return(1);
+	else return(0);
+}
+
+// filter for the query in deb_search_str, from the last result when the query only grew
+static int deb_search_run(void)
+{
+	int      i,j,k,h,n;
+	unsigned g;
+
+	str_lower_string(deb_search_str,m211_s1);
+
+	i=deb_search_sync();
+
+	deb_search_sel=0;
+	deb_search_n=0;
+
+	n=(int)strlen(m211_s1);
+
+	if (n==0)
+	{
+		deb_search_rescnt=0;
+		deb_search_last[0]=0;
+		deb_search_last_ok=0;
+		return(0);
+	}
+
+	if ((i==0)&&(deb_search_last_ok==1)&&(n>(int)strlen(deb_search_last))&&
+	    (strncmp(m211_s1,deb_search_last,strlen(deb_search_last))==0))
+	{
+		k=0;
+		for (j=0;j<deb_search_rescnt;j++)
+		{
+			if (deb_search_match(deb_search_res[j],deb_search_resstamp[j],m211_s1)!=1) continue;
+
+			deb_search_res[k]=deb_search_res[j];
+			deb_search_resstamp[k]=deb_search_resstamp[j];
+			k++;
+		}
+		deb_search_rescnt=k;
+
+		strcpy(deb_search_last,m211_s1);
+		return(0);
+	}
+
+	deb_search_rescnt=0;
+
+	deb_search_gen++;
+	if (deb_search_gen==0) deb_search_gen++;
+	g=deb_search_gen;
+
+	if (n<3)
+	{
+		for (i=0;i<10000;i++)
+		{
+			if (deb_search_match(i,deb_filenamebuff_stamp[i],m211_s1)==1) deb_search_res_add(i,deb_filenamebuff_stamp[i]);
+		}
+
+		for (i=0;i<deb_search_lcnt;i++)
+		{
+			if (deb_search_match(DEB_SEARCH_LIB+i,0,m211_s1)==1) deb_search_res_add(DEB_SEARCH_LIB+i,0);
+		}
+	}
+	else
+	{
+		h=deb_search_tri_best(&deb_search_row,m211_s1);
+
+		for (j=0;(h>=0)&&(j<deb_search_row.cnt[h]);j++)
+		{
+			i=deb_search_row.post[h][j];
+
+			if (deb_search_rmark[i]==g) continue;
+			deb_search_rmark[i]=g;
+
+			if (deb_search_match(i,deb_filenamebuff_stamp[i],m211_s1)==1) deb_search_res_add(i,deb_filenamebuff_stamp[i]);
+		}
+
+		h=deb_search_tri_best(&deb_search_lib,m211_s1);
+
+		for (j=0;(h>=0)&&(j<deb_search_lib.cnt[h]);j++)
+		{
+			i=deb_search_lib.post[h][j];
+
+			if (deb_search_lmark[i]==g) continue;
+			deb_search_lmark[i]=g;
+
+			if (deb_search_match(DEB_SEARCH_LIB+i,0,m211_s1)==1) deb_search_res_add(DEB_SEARCH_LIB+i,0);
+		}
+	}
+
+	strcpy(deb_search_last,m211_s1);
+	deb_search_last_ok=1;
+
+	return(0);
+}
+
+// full path of a result, "" if it is gone
+static int deb_search_path(int i,char *buffer)
+{
+	int id,k;
+
+	buffer[0]=0;
+
+	if ((i<0)||(i>=deb_search_rescnt)) return(-1);
+
+	id=deb_search_res[i];
+
+	if (id<DEB_SEARCH_LIB)
+	{
+		if (deb_filenamebuff[id][0]==0) return(-1);
+		if (deb_filenamebuff_stamp[id]!=deb_search_resstamp[i]) return(-1);
+
+		deb_get_slot_path(id,buffer);
+		return(0);
+	}
+
+	id=id-DEB_SEARCH_LIB;
+	if ((!deb_lib.base)||(deb_search_lserial!=deb_lib_serial)) return(-1);
+	if (id>=deb_search_lcnt) return(-1);
+
+	k=deb_lib.rec[id].parent;
+	if (k<0) return(-1);
+
+	av_strlcpy(buffer,deb_lib.str+deb_lib.rec[k].path,3000);
+	if ((strlen(buffer)>0)&&(buffer[strlen(buffer)-1]!='/')) av_strlcat(buffer,"/",3000);
+	av_strlcat(buffer,deb_lib.str+deb_lib.rec[id].name,3000);
+
+	return(0);
+}
+
+// forget the results that are library records, before the index is mapped again
+static int deb_search_lib_drop(void)
+{
+	int i,k;
+
+	k=0;
+	for (i=0;i<deb_search_rescnt;i++)
+	{
+		if (deb_search_res[i]>=DEB_SEARCH_LIB) continue;
+
+		deb_search_res[k]=deb_search_res[i];
+		deb_search_resstamp[k]=deb_search_resstamp[i];
+		k++;
+	}
+	deb_search_rescnt=k;
+
+	if (deb_search_sel>=deb_search_rescnt) deb_search_sel=deb_search_rescnt-1;
+	if (deb_search_sel<0) deb_search_sel=0;
+	if (deb_search_n>deb_search_sel) deb_search_n=deb_search_sel;
+
+	deb_search_last_ok=0;
+
+	return(0);
+}
+
+// the index was mapped again, search it for the query being shown
+static int deb_search_lib_new(VideoState *is)
+{
+	if (deb_search_on!=1) return(0);
+
+	deb_search_run();
+
+	deb_disp_dir_valid=0;
+	deb_disp_dir(is);
+
+	return(0);
+}
+
+// copy a gb18030 string into at most width columns, not cutting a two bytes char
+static int deb_search_cut(char *in,char *out,int width)
+{
+	int n1,n2;
+
+	n1=(int)strlen(in);
+	n2=0;
+
+	while (n2<n1)
+	{
+		if (in[n2]>=0)
+		{
+			if (n2+1>width) break;
+			out[n2]=in[n2];
+			n2++;
+		}
+		else
+		{
+			if (n2+2>width) break;
+			out[n2+0]=in[n2+0];
+			out[n2+1]=in[n2+1];
+			n2=n2+2;
+		}
+	}
+
+	out[n2]=0;
+
+	return(0);
+}
+
+static char m212_s1[3000];
+static char m212_s2[3000];
+static char m212_s3[3000];
+
+// query line and result rows of deb_disp_dir() in search mode
+static int deb_search_fill(int h,int w)
+{
+	int i,j,n4;
+
+	snprintf(m212_s1,3000,"Search: %s_    (%d)",deb_search_str,deb_search_rescnt);
+
+	for (j=0;j<3000;j++) m212_s2[j]=0;
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+	deb_utf8_to_gb18030(m212_s1,m212_s2,3000);
+#else
+	strcpy(m212_s2,m212_s1);
+#endif
+
+	deb_search_cut(m212_s2,m212_s3,w-4);
+	for (j=0;j<(int)strlen(m212_s3);j++) disp_buff[1][j+2]=m212_s3[j];
+
+	for (n4=0;n4<h-4;n4++)
+	{
+		i=deb_search_n+n4;
+		if (i>=deb_search_rescnt) break;
+
+		if (deb_search_path(i,m212_s1)!=0) continue;
+
+		for (j=0;j<3000;j++) m212_s2[j]=0;
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+		deb_utf8_to_gb18030(m212_s1,m212_s2,3000);
+#else
+		strcpy(m212_s2,m212_s1);
+#endif
+
+		deb_search_cut(m212_s2,m212_s3,w-4);
+		for (j=0;j<(int)strlen(m212_s3);j++) disp_buff[3+n4][j+2]=m212_s3[j];
+	}
+
+	return(0);
+}
+
+// open folder row pp now, without the folder reading thread
+static int deb_scan_now(int pp)
+{
+	if (deb_dcache_get(deb_dir_buffer,pp)==0) return(0);
+	if (deb_lib_get(deb_dir_buffer,pp)==0) return(0);
+
+	// bt_entry() fills the same m202_* as the thread
+	deb_scan_wait();
+
+	deb_get_dir();
+	deb_dir_add_after(pp);
+	deb_dcache_put(deb_dir_buffer,pp);
+
+	return(0);
+}
+
+// open the folders down to path, row of path or -1
+static int deb_search_open(char *path)
+{
+	int   i,k,n,pp,sp;
+	char *p1,*p2;
+
+	pp=(-1);
+
+	for (i=0;i<deb_filenamecnt;i++)
+	{
+		k=deb_row(i);
+		if (deb_filenamebuff_parent[k]>=0) continue;
+
+		n=deb_filenamebuff_namelen[k];
+		if (n<=0) continue;
+
+		if ((strncmp(path,deb_filenamebuff[k]+deb_filenamebuff_name[k],n)==0)&&(path[n-1]=='/'))
+		{
+			pp=i;
+			break;
+		}
+	}
+
+	if (pp<0) return(-1);
+
+	p1=path+deb_filenamebuff_namelen[deb_row(pp)];
+
+	while (*p1)
+	{
+		p2=strchr(p1,'/');
+		if (!p2) p2=p1+strlen(p1);
+
+		n=(int)(p2-p1);
+
+		if (n>0)
+		{
+			if (deb_row(pp)==deb_scan_slot) return(-1);
+
+			if (deb_dir_opened(pp)==0)
+			{
+				deb_get_path(pp);
+
+				chdir(deb_dir_buffer);
+				getcwd(deb_currentpath,3000);
+
+				if (deb_cmp_dir(deb_dir_buffer,deb_currentpath)!=0) return(-1);
+
+				deb_scan_now(pp);
+			}
+
+			k=deb_row(pp);
+			sp=deb_get_space(deb_filenamebuff[k]);
+
+			for (i=pp+1;i<deb_filenamecnt;i++)
+			{
+				k=deb_row(i);
+
+				if (deb_get_space(deb_filenamebuff[k])<=sp) return(-1);
+
+				if ((deb_filenamebuff_parent[k]==deb_row(pp))&&(deb_filenamebuff_namelen[k]==n)&&
+				    (memcmp(deb_filenamebuff[k]+deb_filenamebuff_name[k],p1,n)==0)) break;
+			}
+
+			if (i>=deb_filenamecnt) return(-1);
+
+			pp=i;
+		}
+
+		if (*p2==0) break;
+		p1=p2+1;
+	}
+
+	return(pp);
+}
+
+// leave search mode, showing the selected result in the tree
+static int deb_search_reveal(VideoState *is)
+{
+	int i,pp;
+
+	pp=(-1);
+
+	if ((deb_search_sel>=0)&&(deb_search_sel<deb_search_rescnt))
+	{
+		i=deb_search_res[deb_search_sel];
+
+		if ((i<DEB_SEARCH_LIB)&&(deb_filenamebuff[i][0]!=0)&&(deb_filenamebuff_stamp[i]==deb_search_resstamp[deb_search_sel]))
+		{
+			pp=deb_row_find(i);
+		}
+		else if (deb_search_path(deb_search_sel,m212_s1)==0)
+		{
+			pp=deb_search_open(m212_s1);
+		}
+	}
+
+	deb_search_on=0;
+
+	if (pp>=0)
+	{
+		deb_filenamebuff_n=pp-3;
+		if (deb_filenamebuff_n<0) deb_filenamebuff_n=0;
+	}
+
+	deb_disp_dir_valid=0;
+	deb_disp_dir(is);
+
+	return(0);
+}
+
+// keys while searching, '/' starts it
+static int deb_search_key(VideoState *is,SDL_keysym *key)
+{
+	int h,n;
+
+	h=(is->height/deb_ch_h)-2-4;
+	if (h<1) h=1;
+
+	if (deb_search_on==0)
+	{
+		deb_search_on=1;
+		deb_search_str[0]=0;
+		deb_search_last_ok=0;
+		deb_search_run();
+
+		deb_disp_dir_valid=0;
+		deb_disp_dir(is);
+		return(0);
+	}
+
+	switch (key->sym) {
+	case SDLK_ESCAPE:
+		deb_search_on=0;
+		deb_disp_dir_valid=0;
+		break;
+	case SDLK_RETURN:
+		deb_search_reveal(is);
+		return(0);
+	case SDLK_BACKSPACE:
+		n=(int)strlen(deb_search_str);
+		// drop one utf-8 char
+		while ((n>0)&&((deb_search_str[n-1]&0xC0)==0x80)) n--;
+		if (n>0) n--;
+		deb_search_str[n]=0;
+		deb_search_run();
+		break;
+	case SDLK_UP:
+		deb_search_sel--;
+		break;
+	case SDLK_DOWN:
+		deb_search_sel++;
+		break;
+	case SDLK_PAGEUP:
+		deb_search_sel=deb_search_sel-h;
+		break;
+	case SDLK_PAGEDOWN:
+		deb_search_sel=deb_search_sel+h;
+		break;
+	default:
+		n=(int)strlen(deb_search_str);
+		if (n+4>=DEB_SEARCH_LEN) return(0);
+		if (key->unicode<32) return(0);
+
+		if (key->unicode<0x80)
+		{
+			deb_search_str[n++]=(char)key->unicode;
+		}
+		else if (key->unicode<0x800)
+		{
+			deb_search_str[n++]=(char)(0xC0|(key->unicode>>6));
+			deb_search_str[n++]=(char)(0x80|(key->unicode&0x3F));
+		}
+		else
+		{
+			deb_search_str[n++]=(char)(0xE0|(key->unicode>>12));
+			deb_search_str[n++]=(char)(0x80|((key->unicode>>6)&0x3F));
+			deb_search_str[n++]=(char)(0x80|(key->unicode&0x3F));
+		}
+		deb_search_str[n]=0;
+
+		deb_search_run();
+		break;
+	}
+
+	if (deb_search_sel>=deb_search_rescnt) deb_search_sel=deb_search_rescnt-1;
+	if (deb_search_sel<0) deb_search_sel=0;
+
+	if (deb_search_sel<deb_search_n) deb_search_n=deb_search_sel;
+	if (deb_search_sel>=deb_search_n+h) deb_search_n=deb_search_sel-h+1;
+
+	deb_disp_dir(is);
+
+	return(0);
+}
+
+// mouse click on result row n2
+static int deb_search_click(VideoState *is,int n2)
+{
+	if (deb_search_n+n2>=deb_search_rescnt) return(0);
+
+	deb_search_sel=deb_search_n+n2;
+
+	return(deb_search_reveal(is));
+}
+
+// daipozhi modified for gapless ================================================
+
+static int deb_gap_interrupt(void *ctx)
+{
+	return(deb_gap_abort);
+}
+
+// an opened audio decoder for st, NULL if it can not be opened
+static AVCodecContext *deb_gap_codec(AVStream *st)
+{
+	AVCodecContext  *avctx;
+	AVCodec         *codec;
+	AVDictionary    *opts=NULL;
+
+	avctx=avcodec_alloc_context3(NULL);
+	if (!avctx) return(NULL);
+
+	if (avcodec_parameters_to_context(avctx,st->codecpar)<0) goto fail;
+	av_codec_set_pkt_timebase(avctx,st->time_base);
+
+	if (audio_codec_name) codec=avcodec_find_decoder_by_name(audio_codec_name);
+	else codec=avcodec_find_decoder(avctx->codec_id);
+	if (!codec) goto fail;
+
+	avctx->codec_id=codec->id;
+
+	av_dict_set(&opts,"threads","auto",0);
+	av_dict_set(&opts,"refcounted_frames","1",0);
+	if (avcodec_open2(avctx,codec,&opts)<0) goto fail;
+	av_dict_free(&opts);
+
+	return(avctx);
+
+fail:
+	av_dict_free(&opts);
+	avcodec_free_context(&avctx);
+
+	return(NULL);
+}
+
+static int deb_gap_thread(void *arg)
+{
+	VideoState      *is=arg;
+	AVFormatContext *ic=NULL;
+	AVCodecContext  *avctx=NULL;
+	int              i,idx;
+
+	ic=avformat_alloc_context();
+	if (!ic) goto fail;
+
+	ic->interrupt_callback.callback=deb_gap_interrupt;
+
+	if (file_io_open_input(&ic,deb_gap_path,NULL,NULL)<0) goto fail;
+	if (avformat_find_stream_info(ic,NULL)<0) goto fail;
+
+	idx=av_find_best_stream(ic,AVMEDIA_TYPE_AUDIO,-1,-1,NULL,0);
+	if (idx<0) goto fail;
+
+	// only music follows on, a video file is opened as before
+	for (i=0;i<(int)ic->nb_streams;i++)
+	{
+		if ((ic->streams[i]->codecpar->codec_type==AVMEDIA_TYPE_VIDEO)&&
+		    (!(ic->streams[i]->disposition & AV_DISPOSITION_ATTACHED_PIC))) goto fail;
+	}
+
+	if (deb_gap_abort) goto fail;
+
+	avctx=deb_gap_codec(ic->streams[idx]);
+	if (!avctx) goto fail;
+
+	for (i=0;i<(int)ic->nb_streams;i++)
+	{
+		if (i==idx) ic->streams[i]->discard=AVDISCARD_DEFAULT;
+		else ic->streams[i]->discard=AVDISCARD_ALL;
+	}
+
+	SDL_LockMutex(deb_gap_mutex);
+	deb_gap_ic    =ic;
+	deb_gap_avctx =avctx;
+	deb_gap_stream=idx;
+	deb_gap_state =2;
+	SDL_UnlockMutex(deb_gap_mutex);
+
+	// read_thread() may already sleep at the end of this file
+	read_thread_wake(is);
+
+	return(0);
+
+fail:
+	avcodec_free_context(&avctx);
+	file_io_close_input(&ic);
+
+	SDL_LockMutex(deb_gap_mutex);
+	deb_gap_state=3;
+	SDL_UnlockMutex(deb_gap_mutex);
+
+	return(0);
+}
+
+// forget the prepared file, a file still being opened is given up at once
+static int deb_gap_drop(void)
+{
+	if (!deb_gap_mutex) return(0);
+
+	if (deb_gap_tid)
+	{
+		deb_gap_abort=1;
+		SDL_WaitThread(deb_gap_tid,NULL);
+		deb_gap_tid=NULL;
+		deb_gap_abort=0;
+	}
+
+	SDL_LockMutex(deb_gap_mutex);
+
+	if (deb_gap_state==2)
+	{
+		avcodec_free_context(&deb_gap_avctx);
+		file_io_close_input(&deb_gap_ic);
+	}
+
+	deb_gap_state=0;
+
+	SDL_UnlockMutex(deb_gap_mutex);
+
+	return(0);
+}
+
+static char m213_s1[3000];
+
+// open the row after deb_filenameplay on a thread, so it is ready when this one ends
+static int deb_gap_start(VideoState *is)
+{
+	int  i,pp;
+	char c1;
+
+	if (!deb_gap_mutex)
+	{
+		deb_gap_mutex=SDL_CreateMutex();
+		if (!deb_gap_mutex) return(-1);
+	}
+
+	deb_gap_drop();
+
+	pp=deb_filenameplay+1;
+
+	if (pp<0) return(0);
+	if (pp>=deb_filenamecnt) return(0);
+
+	c1=deb_getfirstchar(deb_filenamebuff[deb_row(pp)]);
+	if ((c1=='|')||(c1==' ')||(c1=='<')) return(0);
+
+	deb_get_path_to(pp,deb_gap_path);
+	if (deb_gap_path[0]==0) return(0);
+
+	deb_filenameext2(deb_gap_path,m213_s1);
+	if (deb_supported_formats(m213_s1)!=1) return(0);
+
+	i=deb_row(pp);
+	deb_gap_slot =i;
+	deb_gap_stamp=deb_filenamebuff_stamp[i];
+	deb_gap_state=1;
+
+	deb_gap_tid=SDL_CreateThread(deb_gap_thread,is);
+	if (!deb_gap_tid)
+	{
+		av_log(NULL, AV_LOG_ERROR, "SDL_CreateThread(): %s\n", SDL_GetError());
+		deb_gap_state=0;
+		return(-1);
+	}
+
+	return(0);
+}
+
+// add a track, under deb_gap_mutex, -1 if there is no memory
+static int deb_gap_add(VideoState *is,AVFormatContext *ic,int stream,int slot,unsigned stamp)
+{
+	GapTrack *p;
+
+	p=av_realloc(is->gap_trk,(is->gap_cnt+1)*sizeof(GapTrack));
+	if (!p) return(-1);
+	is->gap_trk=p;
+
+	is->gap_trk[is->gap_cnt].ic    =ic;
+	is->gap_trk[is->gap_cnt].stream=stream;
+	is->gap_trk[is->gap_cnt].slot  =slot;
+	is->gap_trk[is->gap_cnt].stamp =stamp;
+	is->gap_cnt++;
+
+	return(is->gap_cnt-1);
+}
+
+// called by read_thread() at end of file, put the prepared file behind this one
+// in the same audio queue, -1 if there is none or it can not follow on
+static int deb_gap_take(VideoState *is,AVFormatContext **pic)
+{
+	AVFormatContext  *ic;
+	AVCodecContext   *avctx;
+	AVStream         *st;
+	int               idx,t;
+
+	if (!deb_gap_mutex) return(-1);
+	if (is->read_audio_stream<0) return(-1);
+	if (is->subtitle_stream>=0) return(-1);
+	if ((is->video_stream>=0)&&(!(is->video_st->disposition & AV_DISPOSITION_ATTACHED_PIC))) return(-1);
+
+	// the last one is not in the decoder yet
+	if (is->auddec.gap_avctx) return(-1);
+
+	SDL_LockMutex(deb_gap_mutex);
+
+	if (deb_gap_state!=2)
+	{
+		SDL_UnlockMutex(deb_gap_mutex);
+		return(-1);
+	}
+
+	// the first file is track 0, its row is known when it is left
+	if ((is->gap_cnt==0)&&(deb_gap_add(is,is->read_ic,is->read_audio_stream,-1,0)<0))
+	{
+		SDL_UnlockMutex(deb_gap_mutex);
+		return(-1);
+	}
+
+	t=deb_gap_add(is,deb_gap_ic,deb_gap_stream,deb_gap_slot,deb_gap_stamp);
+	if (t<0)
+	{
+		SDL_UnlockMutex(deb_gap_mutex);
+		return(-1);
+	}
+
+	ic   =deb_gap_ic;
+	avctx=deb_gap_avctx;
+	idx  =deb_gap_stream;
+
+	deb_gap_ic   =NULL;
+	deb_gap_avctx=NULL;
+	deb_gap_state=0;
+
+	SDL_UnlockMutex(deb_gap_mutex);
+
+	st=ic->streams[idx];
+
+	// the index is of the old file, seeks in the next one go the usual way
+	deb_kidx_close(is);
+
+	if ((is->video_stream>=0)&&(!is->gap_vic)) is->gap_vic=is->read_ic;
+
+	// the null packet drains the old decoder, deb_gap_pkt gives it the new one
+	packet_queue_put_nullpacket(&is->audioq, is->read_audio_stream);
+
+	SDL_LockMutex(is->audioq.mutex);
+	is->auddec.gap_start_pts   =st->start_time;
+	is->auddec.gap_start_pts_tb=st->time_base;
+	is->auddec.gap_track       =t;
+	is->auddec.gap_avctx       =avctx;
+	SDL_UnlockMutex(is->audioq.mutex);
+
+	// the old input stays open till stream_close(), the event thread reads it
+	// till the audio callback reaches the next file
+	is->read_ic          =ic;
+	is->read_audio_stream=idx;
+	is->read_audio_st    =st;
+	is->read_track       =t;
+	is->audioq.time_base =av_q2d(st->time_base);
+
+	*pic=ic;
+
+	packet_queue_put(&is->audioq, &deb_gap_pkt);
+
+	return(0);
+}
+
+// called by read_thread() for a seek asked while the next file was already read,
+// go back to the track being heard, -1 if it can not
+static int deb_gap_back(VideoState *is,AVFormatContext **pic)
+{
+	AVCodecContext *avctx;
+	AVStream       *st;
+	GapTrack        e;
+	SDL_Event       event;
+	int             t;
+
+	t=is->seek_track;
+
+	SDL_LockMutex(deb_gap_mutex);
+	if ((t<0)||(t>=is->gap_cnt))
+	{
+		SDL_UnlockMutex(deb_gap_mutex);
+		return(-1);
+	}
+	e=is->gap_trk[t];
+	SDL_UnlockMutex(deb_gap_mutex);
+
+	st=e.ic->streams[e.stream];
+
+	avctx=deb_gap_codec(st);
+	if (!avctx) return(-1);
+
+	// a decoder not taken yet is dropped, if the next one was taken already
+	// this one is handed over behind the flush packet of the seek
+	SDL_LockMutex(is->audioq.mutex);
+	avcodec_free_context(&is->auddec.gap_avctx);
+	if (is->auddec.track!=t)
+	{
+		is->auddec.gap_start_pts   =st->start_time;
+		is->auddec.gap_start_pts_tb=st->time_base;
+		is->auddec.gap_track       =t;
+		is->auddec.gap_avctx       =avctx;
+		avctx=NULL;
+	}
+	SDL_UnlockMutex(is->audioq.mutex);
+
+	avcodec_free_context(&avctx);
+
+	is->read_ic          =e.ic;
+	is->read_audio_stream=e.stream;
+	is->read_audio_st    =st;
+	is->read_track       =t;
+	is->audioq.time_base =av_q2d(st->time_base);
+
+	*pic=e.ic;
+
+	// the next file was used up, the event thread prepares it again
+	event.type = FF_GAP_EVENT;
+	event.user.code = t;
+	event.user.data1 = is;
+	deb_push_event(&event);
+
+	return(0);
+}
+
+// the audio callback reached another file, show it as playing and prepare the one after
+static int deb_gap_next(VideoState *is,int track)
+{
+	GapTrack e;
+	int      i,pp;
+
+	if (!deb_gap_mutex) return(0);
+
+	SDL_LockMutex(deb_gap_mutex);
+
+	if ((track<0)||(track>=is->gap_cnt))
+	{
+		SDL_UnlockMutex(deb_gap_mutex);
+		return(0);
+	}
+
+	// the row of the track left, for a seek that goes back to it
+	if ((is->play_track>=0)&&(is->play_track<is->gap_cnt)&&(is->gap_trk[is->play_track].slot<0))
+	{
+		i=deb_row(deb_filenameplay);
+		if (i>=0)
+		{
+			is->gap_trk[is->play_track].slot =i;
+			is->gap_trk[is->play_track].stamp=deb_filenamebuff_stamp[i];
+		}
+	}
+
+	e=is->gap_trk[track];
+
+	SDL_UnlockMutex(deb_gap_mutex);
+
+	if (track!=is->play_track)
+	{
+		is->ic          =e.ic;
+		is->audio_stream=e.stream;
+		is->audio_st    =e.ic->streams[e.stream];
+		is->play_track  =track;
+
+		// the sound river starts again with the file
+		deb_sr_time_set=0;
+		deb_sr_total_bytes=0;
+		deb_sr_show_init=0;
+		deb_sr_river_over=0;
+		deb_sr_sample_over=0;
+		deb_sr_sample_over2=0;
+		deb_sr_river_pp=0;
+		deb_sr_river_last=0;
+		deb_sr_river_adj=0;
+
+		pp=(-1);
+		if ((e.slot>=0)&&(e.slot<10000)&&(deb_filenamebuff_stamp[e.slot]==e.stamp)) pp=deb_row_find(e.slot);
+		if (pp<0) pp=deb_filenameplay+1;
+		if (pp>=deb_filenamecnt) return(0);
+
+		deb_filenameplay=pp;
+
+		deb_get_path(deb_filenameplay);
+
+		if ((deb_str_has_null(deb_dir_buffer,3000)==1)&&(strlen(deb_dir_buffer)<3000)) strcpy(deb_currentpath,deb_dir_buffer);
+
+		deb_disp_dir(is);
+		deb_disp_scrn(is);
+	}
+
+	deb_gap_start(is);
+
+	return(0);
+}
+
+// daipozhi modified for event driven main loop
+static int deb_wake_filter(const SDL_Event *event)
+{
+	deb_wake();
+
+	return(1);
+}
+
+static int deb_wake_init(void)
+{
+	deb_wake_mutex=SDL_CreateMutex();
+	deb_wake_cond =SDL_CreateCond();
+
+	if ((!deb_wake_mutex)||(!deb_wake_cond))
+	{
+		av_log(NULL, AV_LOG_FATAL, "SDL_CreateMutex(): %s\n", SDL_GetError());
+		exit(1);
+	}
+
+	// runs on SDL's event thread, so mouse and keys end the sleep at once
+	SDL_SetEventFilter(deb_wake_filter);
+
+	return(0);
+}
+
+static int deb_wake(void)
+{
+	if (!deb_wake_mutex) return(0);
+
+	SDL_LockMutex(deb_wake_mutex);
+	deb_wake_flag=1;
+	SDL_CondSignal(deb_wake_cond);
+	SDL_UnlockMutex(deb_wake_mutex);
+
+	return(0);
+}
+
+static int deb_post(int code)
+{
+	SDL_Event event;
+	int       post;
+
+	if (!deb_wake_mutex) return(0);
+
+	SDL_LockMutex(deb_wake_mutex);
+
+	post=!(deb_wake_pending&code);
+	deb_wake_pending=deb_wake_pending|code;
+
+	if (post)
+	{
+		event.type = FF_WAKE_EVENT;
+		event.user.code = code;
+		event.user.data1 = NULL;
+		if (SDL_PushEvent(&event)<0) deb_wake_pending=deb_wake_pending&(~code);
+	}
+
+	deb_wake_flag=1;
+	SDL_CondSignal(deb_wake_cond);
+	SDL_UnlockMutex(deb_wake_mutex);
+
+	return(0);
+}
+
+static int deb_push_event(SDL_Event *event)
+{
+	int i;
+
+	i=SDL_PushEvent(event);
+	deb_wake();
+
+	return(i);
+}
+
+static int deb_wake_wait(double t)
+{
+	SDL_LockMutex(deb_wake_mutex);
+
+	if (deb_wake_flag==0) SDL_CondWaitTimeout(deb_wake_cond,deb_wake_mutex,(Uint32)(t*1000.0+0.5));
+	deb_wake_flag=0;
+
+	SDL_UnlockMutex(deb_wake_mutex);
+
+	return(0);
+}
+
+static int deb_wake_event(int code)
+{
+	double now;
+
+	SDL_LockMutex(deb_wake_mutex);
+	deb_wake_pending=deb_wake_pending&(~code);
+	SDL_UnlockMutex(deb_wake_mutex);
+
+	if (deb_frame_num<60) return(0);
+
+	now=av_gettime_relative() / 1000000.0;
+
+	if (code&(DEB_WAKE_FRAME|DEB_WAKE_READY)) deb_timer[DEB_TIMER_VIDEO]=now;
+	if (code&(DEB_WAKE_SECOND|DEB_WAKE_READY)) deb_timer[DEB_TIMER_BAR]=now;
+
+	return(0);
+}
+
+static double deb_timer_next(void)
+{
+	double now,t;
+	int    i;
+
+	now=av_gettime_relative() / 1000000.0;
+	t=DEB_IDLE_WAIT;
+
+	for (i=0;i<DEB_TIMER_NB;i++)
+	{
+		if (deb_timer[i]<=0) continue;
+		if (deb_timer[i]-now<t) t=deb_timer[i]-now;
+	}
+
+	if (t<0) t=0;
+
+	return(t);
+}
+
+static int deb_timer_video(VideoState *is,double now)
+{
+	double remaining_time;
+
+	if ((!deb_thr_v)||(!deb_thr_a)||(!deb_thr_a2)||(!deb_thr_r)||(!is->video_st)||
+	    (is->show_mode == SHOW_MODE_NONE)||((is->paused)&&(!is->force_refresh)))
+	{
+		deb_timer[DEB_TIMER_VIDEO]=0;   // a FF_WAKE_EVENT or a key sets it again
+		return(0);
+	}
+
+	if ((deb_timer[DEB_TIMER_VIDEO]>now)&&(!is->force_refresh)) return(0);
+
+	// video_refresh() only lowers it when a picture is waiting and not due;
+	// after one was shown the next is looked at again after REFRESH_RATE, as
+	// before, so its deadline is known. The idle wait is only for an empty
+	// queue, a new picture there posts DEB_WAKE_FRAME, or when paused
+	remaining_time=DEB_IDLE_WAIT;
+	video_refresh(is, &remaining_time);
+	if ((!is->paused)&&(remaining_time>=DEB_IDLE_WAIT)&&(frame_queue_nb_remaining(&is->pictq)>0))
+		remaining_time=REFRESH_RATE;
+	deb_timer[DEB_TIMER_VIDEO]=now+remaining_time;
+
+	return(0);
+}
+
+// daipozhi modified for keyframe seek index ======================================
+
+static char m214_s1[3000];
+static char m214_s2[3000];
+
+// 0 when the format is one that seeks by reading around in the file,
+// raw streams are not: they get timestamps from cur_dts, which a byte seek
+// loses, and lavf already keeps an index for them
+static int deb_kidx_format(AVFormatContext *ic)
+{
+	static const char *names[]={"mpegts","mpeg",NULL};
+	int i;
+
+	if (ic->iformat->flags&AVFMT_NO_BYTE_SEEK) return(-1);
+
+	for (i=0;names[i];i++)
+	{
+		if (strcmp(ic->iformat->name,names[i])==0) return(0);
+	}
+
+	return(-1);
+}
+
+static int deb_kidx_grow(VideoState *is)
+{
+	void *p;
+	int   n;
+
+	n=is->kidx_max*2+1024;
+	if (n>DEB_KIDX_MAX) n=DEB_KIDX_MAX;
+	if (n<=is->kidx_max) return(-1);
+
+	p=av_realloc(is->kidx_time,n*sizeof(int64_t));
+	if (!p) return(-1);
+	is->kidx_time=p;
+
+	p=av_realloc(is->kidx_pos,n*sizeof(int64_t));
+	if (!p) return(-1);
+	is->kidx_pos=p;
+
+	is->kidx_max=n;
+
+	return(0);
+}
+
+// first entry with time > t
+static int deb_kidx_upper(VideoState *is,int64_t t)
+{
+	int lo,hi,mid;
+
+	lo=0;
+	hi=is->kidx_cnt;
+
+	while (lo<hi)
+	{
+		mid=(lo+hi)/2;
+		if (is->kidx_time[mid]<=t) lo=mid+1;
+		else                       hi=mid;
+	}
+
+	return(lo);
+}
+
+static int deb_kidx_open(VideoState *is)
+{
+	AVFormatContext *ic=is->ic;
+	struct stat      info;
+	DebKidxHead      head;
+	FILE            *fp;
+	uint64_t         h;
+	char            *p;
+	int              i;
+
+	is->kidx_on=0;
+	is->kidx_cnt=0;
+	is->kidx_dirty=0;
+
+	if (!ic) return(0);
+	if (!(ic->flags&AVFMT_FLAG_CUSTOM_IO)) return(0);
+	if (deb_kidx_format(ic)!=0) return(0);
+
+	if (is->video_stream>=0) is->kidx_stream=is->video_stream;
+	else                     is->kidx_stream=is->audio_stream;
+	if (is->kidx_stream<0) return(0);
+
+	if (stat(is->filename,&info)!=0) return(0);
+
+	is->kidx_size =info.st_size;
+	is->kidx_mtime=info.st_mtime;
+
+	// fnv-1a of the path names the file
+	h=14695981039346656037ULL;
+	for (p=is->filename;*p;p++)
+	{
+		h^=(unsigned char)(*p);
+		h*=1099511628211ULL;
+	}
+
+	snprintf(is->kidx_fn,3000,"%s/library/seek/%016llx.idx",deb_lib_home,(unsigned long long)h);
+
+	if (deb_kidx_grow(is)!=0) return(0);
+
+	is->kidx_on=1;
+
+	fp=fopen(is->kidx_fn,"rb");
+	if (!fp) return(0);
+
+	if ((fread(&head,sizeof(head),1,fp)==1)&&(memcmp(head.magic,"PPKI",4)==0)&&(head.version==DEB_KIDX_VERSION)&&
+	    (head.size==is->kidx_size)&&(head.mtime==is->kidx_mtime)&&(head.cnt>0)&&(head.cnt<=DEB_KIDX_MAX))
+	{
+		while (is->kidx_max<head.cnt)
+		{
+			if (deb_kidx_grow(is)!=0) break;
+		}
+
+		if (is->kidx_max>=head.cnt)
+		{
+			for (i=0;i<head.cnt;i++)
+			{
+				if (fread(&is->kidx_time[i],sizeof(int64_t),1,fp)!=1) break;
+				if (fread(&is->kidx_pos[i] ,sizeof(int64_t),1,fp)!=1) break;
+				if ((i>0)&&(is->kidx_time[i]<=is->kidx_time[i-1])) break;
+			}
+
+			if (i==head.cnt) is->kidx_cnt=i;
+		}
+	}
+
+	fclose(fp);
+
+	return(0);
+}
+
+// called by read_thread for every packet
+static int deb_kidx_add(VideoState *is,AVPacket *pkt)
+{
+	AVStream *st;
+	int64_t   t,ts;
+	int       i;
+
+	if (pkt->stream_index!=is->kidx_stream) return(0);
+	if (!(pkt->flags&AV_PKT_FLAG_KEY)) return(0);
+	if (pkt->pos<0) return(0);
+
+	ts=(pkt->pts!=AV_NOPTS_VALUE) ? pkt->pts : pkt->dts;
+	if (ts==AV_NOPTS_VALUE) return(0);
+
+	st=is->ic->streams[pkt->stream_index];
+
+	t=av_rescale_q(ts,st->time_base,AV_TIME_BASE_Q);
+
+	i=deb_kidx_upper(is,t);
+
+	if ((i>0)&&(t-is->kidx_time[i-1]<DEB_KIDX_GAP)) return(0);
+	if ((i<is->kidx_cnt)&&(is->kidx_time[i]-t<DEB_KIDX_GAP)) return(0);
+
+	if ((is->kidx_cnt>=is->kidx_max)&&(deb_kidx_grow(is)!=0)) return(0);
+
+	if (i<is->kidx_cnt)
+	{
+		memmove(is->kidx_time+i+1,is->kidx_time+i,(is->kidx_cnt-i)*sizeof(int64_t));
+		memmove(is->kidx_pos+i+1 ,is->kidx_pos+i ,(is->kidx_cnt-i)*sizeof(int64_t));
+	}
+
+	is->kidx_time[i]=t;
+	is->kidx_pos[i] =pkt->pos;
+	is->kidx_cnt++;
+	is->kidx_dirty=1;
+
+	return(0);
+}
+
+// byte offset of the last indexed keyframe at or before target, -1 if none is near
+static int deb_kidx_find(VideoState *is,int64_t target,int64_t min,int64_t max,int64_t *pos)
+{
+	int i;
+
+	if ((!is->kidx_on)||(is->kidx_cnt<=0)) return(-1);
+
+	i=deb_kidx_upper(is,target)-1;
+
+	// a seek forward must not land before min
+	if ((i<0)||(is->kidx_time[i]<min)) i++;
+	if (i>=is->kidx_cnt) return(-1);
+
+	if ((is->kidx_time[i]<min)||(is->kidx_time[i]>max)) return(-1);
+	if (FFABS(is->kidx_time[i]-target)>DEB_KIDX_NEAR) return(-1);
+
+	*pos=is->kidx_pos[i];
+
+	return(0);
+}
+
+static int deb_kidx_save(VideoState *is)
+{
+	DebKidxHead head;
+	FILE       *fp;
+	int         i,err;
+
+	snprintf(m214_s1,3000,"%s/library/seek",deb_lib_home);
+#if defined(_WIN32)
+	mkdir(m214_s1);
+#else
+	mkdir(m214_s1,0755);
+#endif
+
+	memset(&head,0,sizeof(head));
+	memcpy(head.magic,"PPKI",4);
+	head.version=DEB_KIDX_VERSION;
+	head.cnt    =is->kidx_cnt;
+	head.size   =is->kidx_size;
+	head.mtime  =is->kidx_mtime;
+
+	snprintf(m214_s2,3000,"%s.tmp",is->kidx_fn);
+
+	fp=fopen(m214_s2,"wb");
+	if (!fp) return(-1);
+
+	err=0;
+	if (fwrite(&head,sizeof(head),1,fp)!=1) err=(-1);
+	for (i=0;(i<is->kidx_cnt)&&(err==0);i++)
+	{
+		if (fwrite(&is->kidx_time[i],sizeof(int64_t),1,fp)!=1) err=(-1);
+		if (fwrite(&is->kidx_pos[i] ,sizeof(int64_t),1,fp)!=1) err=(-1);
+	}
+	if (fclose(fp)!=0) err=(-1);
+
+	if (err!=0)
+	{
+		remove(m214_s2);
+		return(-1);
+	}
+
+#if defined(_WIN32)
+	remove(is->kidx_fn);
+#endif
+	if (rename(m214_s2,is->kidx_fn)!=0) return(-1);
+
+	return(0);
+}
+
+// write the index back if it grew and free it
+static int deb_kidx_close(VideoState *is)
+{
+	if ((is->kidx_on)&&(is->kidx_dirty)&&(is->kidx_cnt>=2)) deb_kidx_save(is);
+
+	av_freep(&is->kidx_time);
+	av_freep(&is->kidx_pos);
+
+	is->kidx_cnt  =0;
+	is->kidx_max  =0;
+	is->kidx_on   =0;
+	is->kidx_dirty=0;
+
+	return(0);
+}
+
+// daipozhi modified for seek bar preview ========================================
+
+static char m215_s1[3000];
+
+// seek to bar position xx, as a click on the bar always did
+static int deb_bar_seek(VideoState *is,int xx)
+{
+    double x = xx, frac;
+
+                if (seek_by_bytes || is->ic->duration <= 0) {
+                    uint64_t size =  avio_size(is->ic->pb);
+                    stream_seek(is, size*x/is->width, 0, 1);
+                } else {
+                    int64_t ts;
+                    int ns, hh, mm, ss;
+                    int tns, thh, tmm, tss;
+                    tns  = is->ic->duration / 1000000LL;
+                    thh  = tns / 3600;
+                    tmm  = (tns % 3600) / 60;
+                    tss  = (tns % 60);
+                    frac = x / is->width;
+                    ns   = frac * tns;
+                    hh   = ns / 3600;
+                    mm   = (ns % 3600) / 60;
+                    ss   = (ns % 60);
+                    av_log(NULL, AV_LOG_INFO,
+                           "Seek to %2.0f%% (%2d:%02d:%02d) of total duration (%2d:%02d:%02d)       \n", frac*100,
+                            hh, mm, ss, thh, tmm, tss);
+                    ts = frac * is->ic->duration;
+                    if (is->ic->start_time != AV_NOPTS_VALUE)
+                        ts += is->ic->start_time;
+                    stream_seek(is, ts, 0, 0);
+                }
+
+	return(0);
+}
+
+// bar position x to one of DEB_SCRUB_STEPS positions and the time shown for it
+static int64_t deb_scrub_pos(VideoState *is,int x,int64_t *ts)
+{
+	int64_t step,t,b;
+
+	step=is->ic->duration/DEB_SCRUB_STEPS;
+	if (step<AV_TIME_BASE) step=AV_TIME_BASE;
+
+	if (x<0) x=0;
+	if (x>=is->width) x=is->width-1;
+
+	t=(int64_t)((double)x/is->width*is->ic->duration);
+	b=t/step;
+
+	t=b*step+step/2;
+	if (t>is->ic->duration) t=is->ic->duration;
+	if (is->ic->start_time!=AV_NOPTS_VALUE) t+=is->ic->start_time;
+
+	*ts=t;
+
+	return(b);
+}
+
+// cache entry of file/bucket, -1 if not there, called with deb_scrub_mutex held
+static int deb_scrub_cache_find(int file,int64_t bucket)
+{
+	int i;
+
+	for (i=0;i<DEB_SCRUB_CACHE;i++)
+	{
+		if ((deb_scrub_csurf[i])&&(deb_scrub_cfile[i]==file)&&(deb_scrub_cbucket[i]==bucket))
+		{
+			deb_scrub_cused[i]=++deb_scrub_clock;
+			return(i);
+		}
+	}
+
+	return(-1);
+}
+
+// keep surf in the least recently used entry, called with deb_scrub_mutex held
+static int deb_scrub_cache_put(int file,int64_t bucket,SDL_Surface *surf)
+{
+	int i,j;
+
+	j=0;
+	for (i=0;i<DEB_SCRUB_CACHE;i++)
+	{
+		if (!deb_scrub_csurf[i])
+		{
+			j=i;
+			break;
+		}
+		if (deb_scrub_cused[i]<deb_scrub_cused[j]) j=i;
+	}
+
+	if (deb_scrub_csurf[j]) SDL_FreeSurface(deb_scrub_csurf[j]);
+
+	deb_scrub_csurf[j]  =surf;
+	deb_scrub_cfile[j]  =file;
+	deb_scrub_cbucket[j]=bucket;
+	deb_scrub_cused[j]  =++deb_scrub_clock;
+
+	return(j);
+}
+
+static int deb_scrub_close(AVFormatContext **pic,AVCodecContext **pavctx)
+{
+	avcodec_free_context(pavctx);
+	file_io_close_input(pic);
+
+	return(0);
+}
+
+// open path with the smallest decoder output that is still DEB_SCRUB_W wide
+static int deb_scrub_open(char *path,AVFormatContext **pic,AVCodecContext **pavctx,int *pidx)
+{
+	AVFormatContext *ic=NULL;
+	AVCodecContext  *avctx=NULL;
+	AVCodec         *codec;
+	AVDictionary    *opts=NULL;
+	int              i,idx,lowres;
+
+	if (file_io_open_input(&ic,path,NULL,NULL)<0) goto fail;
+	if (avformat_find_stream_info(ic,NULL)<0) goto fail;
+
+	idx=av_find_best_stream(ic,AVMEDIA_TYPE_VIDEO,-1,-1,NULL,0);
+	if (idx<0) goto fail;
+	if (ic->streams[idx]->disposition & AV_DISPOSITION_ATTACHED_PIC) goto fail;
+
+	avctx=avcodec_alloc_context3(NULL);
+	if (!avctx) goto fail;
+
+	if (avcodec_parameters_to_context(avctx,ic->streams[idx]->codecpar)<0) goto fail;
+	av_codec_set_pkt_timebase(avctx,ic->streams[idx]->time_base);
+
+	if (video_codec_name) codec=avcodec_find_decoder_by_name(video_codec_name);
+	else codec=avcodec_find_decoder(avctx->codec_id);
+	if (!codec) goto fail;
+
+	avctx->codec_id=codec->id;
+
+	lowres=0;
+	while ((lowres<av_codec_get_max_lowres(codec))&&((avctx->width>>(lowres+1))>=DEB_SCRUB_W)) lowres++;
+	av_codec_set_lowres(avctx,lowres);
+
+	avctx->skip_frame=AVDISCARD_NONKEY;
+
+	// one frame at a time, frame threads would only hold it back
+	av_dict_set(&opts,"threads","1",0);
+	if (avcodec_open2(avctx,codec,&opts)<0) goto fail;
+	av_dict_free(&opts);
+
+	for (i=0;i<(int)ic->nb_streams;i++)
+	{
+		if (i==idx) ic->streams[i]->discard=AVDISCARD_NONKEY;
+		else ic->streams[i]->discard=AVDISCARD_ALL;
+	}
+
+	*pic   =ic;
+	*pavctx=avctx;
+	*pidx  =idx;
+
+	return(0);
+
+fail:
+	av_dict_free(&opts);
+	deb_scrub_close(&ic,&avctx);
+
+	return(-1);
+}
+
+// the keyframe at or before ts in frame, 1 if there is one; gives up when a newer request comes
+static int deb_scrub_decode(AVFormatContext *ic,AVCodecContext *avctx,int idx,int64_t ts,AVFrame *frame)
+{
+	AVPacket pkt;
+	int      n,got;
+
+	if (avformat_seek_file(ic,-1,INT64_MIN,ts,ts,0)<0) return(0);
+
+	avcodec_flush_buffers(avctx);
+
+	for (n=0;n<DEB_SCRUB_PKTS;n++)
+	{
+		if (deb_scrub_want>=0) return(0);
+
+		if (av_read_frame(ic,&pkt)<0) return(0);
+
+		if ((pkt.stream_index!=idx)||(!(pkt.flags&AV_PKT_FLAG_KEY)))
+		{
+			av_packet_unref(&pkt);
+			continue;
+		}
+
+		got=0;
+		avcodec_decode_video2(avctx,frame,&got,&pkt);
+		av_packet_unref(&pkt);
+
+		// a decoder with delay gives the picture out when drained
+		if (!got)
+		{
+			av_init_packet(&pkt);
+			pkt.data=NULL;
+			pkt.size=0;
+			avcodec_decode_video2(avctx,frame,&got,&pkt);
+		}
+
+		if (got) return(1);
+	}
+
+	return(0);
+}
+
+// the frame at preview size, NULL on failure
+static SDL_Surface *deb_scrub_surface(struct SwsContext **psws,AVFrame *frame)
+{
+	SDL_Surface *surf;
+	uint8_t     *data[4];
+	int          linesize[4];
+	double       ar;
+	int          w,h;
+
+	ar=(double)frame->width/frame->height;
+	if (frame->sample_aspect_ratio.num>0) ar*=av_q2d(frame->sample_aspect_ratio);
+
+	w=DEB_SCRUB_W;
+	h=(int)(w/ar)&~1;
+	if (h<16) h=16;
+	if (h>DEB_SCRUB_W*2) h=DEB_SCRUB_W*2;
+
+	*psws=sws_getCachedContext(*psws,frame->width,frame->height,frame->format,w,h,AV_PIX_FMT_RGB32,SWS_FAST_BILINEAR,NULL,NULL,NULL);
+	if (!*psws) return(NULL);
+
+	surf=SDL_CreateRGBSurface(SDL_SWSURFACE,w,h,32,0x00FF0000,0x0000FF00,0x000000FF,0);
+	if (!surf) return(NULL);
+
+	memset(data,0,sizeof(data));
+	memset(linesize,0,sizeof(linesize));
+
+	SDL_LockSurface(surf);
+	data[0]    =surf->pixels;
+	linesize[0]=surf->pitch;
+	sws_scale(*psws,frame->data,frame->linesize,0,frame->height,data,linesize);
+	SDL_UnlockSurface(surf);
+
+	return(surf);
+}
+
+static int deb_scrub_thread(void *arg)
+{
+	AVFormatContext   *ic=NULL;
+	AVCodecContext    *avctx=NULL;
+	struct SwsContext *sws=NULL;
+	AVFrame           *frame;
+	SDL_Surface       *surf;
+	SDL_Event          event;
+	int64_t            ts,bucket;
+	int                file,opened,idx,i;
+
+	frame=av_frame_alloc();
+	if (!frame) return(0);
+
+	opened=(-1);
+	idx=(-1);
+
+	for (;;)
+	{
+		SDL_LockMutex(deb_scrub_mutex);
+
+		while (deb_scrub_want<0)
+		{
+			if ((SDL_CondWaitTimeout(deb_scrub_cond,deb_scrub_mutex,DEB_SCRUB_IDLE)==SDL_MUTEX_TIMEDOUT)&&(ic)) break;
+		}
+
+		// idle, don't keep the file open
+		if (deb_scrub_want<0)
+		{
+			SDL_UnlockMutex(deb_scrub_mutex);
+			deb_scrub_close(&ic,&avctx);
+			opened=(-1);
+			continue;
+		}
+
+		file  =deb_scrub_want;
+		bucket=deb_scrub_want_bucket;
+		ts    =deb_scrub_want_ts;
+
+		deb_scrub_want=(-1);
+
+		if (file!=opened)
+		{
+			deb_scrub_close(&ic,&avctx);
+			strcpy(m215_s1,deb_scrub_path);
+			opened=file;
+		}
+
+		SDL_UnlockMutex(deb_scrub_mutex);
+
+		if ((!ic)&&(deb_scrub_open(m215_s1,&ic,&avctx,&idx)<0)) continue;
+
+		if (deb_scrub_decode(ic,avctx,idx,ts,frame)!=1) continue;
+
+		surf=deb_scrub_surface(&sws,frame);
+		av_frame_unref(frame);
+		if (!surf) continue;
+
+		SDL_LockMutex(deb_scrub_mutex);
+		i=deb_scrub_cache_put(file,bucket,surf);
+		if (file==deb_scrub_file) deb_scrub_show=i;
+		SDL_UnlockMutex(deb_scrub_mutex);
+
+		event.type = FF_SCRUB_EVENT;
+		event.user.data1 = NULL;
+		deb_push_event(&event);
+	}
+
+	return(0);
+}
+
+// the button went down on the bar, -1 if there is no video to preview
+static int deb_scrub_begin(VideoState *is,int x)
+{
+	if ((!is->ic)||(!is->video_st)||(is->video_st->disposition & AV_DISPOSITION_ATTACHED_PIC)) return(-1);
+	if ((seek_by_bytes)||(is->ic->duration<=0)) return(-1);
+
+	if (!deb_scrub_mutex)
+	{
+		deb_scrub_mutex=SDL_CreateMutex();
+		deb_scrub_cond =SDL_CreateCond();
+		if ((!deb_scrub_mutex)||(!deb_scrub_cond)) return(-1);
+
+		deb_scrub_want=(-1);
+		deb_scrub_show=(-1);
+
+		deb_scrub_tid=SDL_CreateThread(deb_scrub_thread,NULL);
+		if (!deb_scrub_tid) return(-1);
+	}
+
+	SDL_LockMutex(deb_scrub_mutex);
+	if (strcmp(deb_scrub_path,is->filename)!=0)
+	{
+		snprintf(deb_scrub_path,3000,"%s",is->filename);
+		deb_scrub_file++;
+	}
+	deb_scrub_show=(-1);
+	SDL_UnlockMutex(deb_scrub_mutex);
+
+	deb_scrub_on=1;
+	deb_scrub_bucket=(-1);
+
+	deb_scrub_move(is,x);
+
+	return(0);
+}
+
+// the pointer moved with the button down, only the newest position is asked for
+static int deb_scrub_move(VideoState *is,int x)
+{
+	int64_t b,ts;
+	int     i;
+
+	if (x!=deb_scrub_x)
+	{
+		deb_scrub_x=x;
+		deb_scrub_event(is);
+	}
+
+	b=deb_scrub_pos(is,x,&ts);
+	if (b==deb_scrub_bucket) return(0);
+
+	deb_scrub_bucket=b;
+
+	SDL_LockMutex(deb_scrub_mutex);
+
+	i=deb_scrub_cache_find(deb_scrub_file,b);
+	if (i>=0)
+	{
+		deb_scrub_show=i;
+		deb_scrub_want=(-1);
+	}
+	else
+	{
+		// the last preview stays up till the new one is decoded
+		deb_scrub_want=deb_scrub_file;
+		deb_scrub_want_bucket=b;
+		deb_scrub_want_ts=ts;
+		SDL_CondSignal(deb_scrub_cond);
+	}
+
+	SDL_UnlockMutex(deb_scrub_mutex);
+
+	if (i>=0) deb_scrub_event(is);
+
+	return(0);
+}
+
+// the button was let go, the preview goes and playback seeks there if seek is 1
+static int deb_scrub_end(VideoState *is,int x,int seek)
+{
+	deb_scrub_on=0;
+
+	SDL_LockMutex(deb_scrub_mutex);
+	deb_scrub_want=(-1);
+	deb_scrub_show=(-1);
+	SDL_UnlockMutex(deb_scrub_mutex);
+
+	// paint over the preview
+	if (deb_cover_close==1)
+	{
+		deb_disp_dir_valid=0;
+		deb_disp_dir(is);
+	}
+	else
+	{
+		deb_border=0;
+		is->force_refresh=1;
+	}
+
+	if (seek) deb_bar_seek(is,x);
+
+	return(0);
+}
+
+// draw the preview above the bar at the pointer
+static int deb_scrub_draw(VideoState *is)
+{
+	SDL_Surface *surf;
+	SDL_Rect     rect;
+	int          white;
+
+	SDL_LockMutex(deb_scrub_mutex);
+
+	surf=NULL;
+	if (deb_scrub_show>=0) surf=deb_scrub_csurf[deb_scrub_show];
+
+	if (surf)
+	{
+		rect.w=surf->w;
+		rect.h=surf->h;
+
+		rect.x=FFMIN(FFMAX(deb_scrub_x-surf->w/2,1),is->width-surf->w-1);
+		rect.y=is->height-deb_ch_h*2-deb_ch_d-surf->h-2;
+
+		if ((rect.x>=1)&&(rect.y>=1))
+		{
+			white=SDL_MapRGB(screen->format,0xFF,0xFF,0xFF);
+			fill_rectangle(screen,rect.x-1,rect.y-1,rect.w+2,rect.h+2,white,0);
+
+			SDL_BlitSurface(surf,NULL,screen,&rect);
+			SDL_UpdateRect(screen,rect.x-1,rect.y-1,surf->w+2,surf->h+2);
+		}
+	}
+
+	SDL_UnlockMutex(deb_scrub_mutex);
+
+	return(0);
+}
+
+// a preview is ready or the pointer moved: redraw it
+static int deb_scrub_event(VideoState *is)
+{
+	if (!deb_scrub_on) return(0);
+
+	// over the video the next display paints the picture and then the preview
+	if (deb_cover_close==1)
+	{
+		deb_disp_dir_valid=0;
+		deb_disp_dir(is);
+		deb_scrub_draw(is);
+	}
+	else is->force_refresh=1;
+
+	return(0);
+}
+
 /*
 static int  bt_findclose( void)
 {
@@ -10868,6 +16281,7 @@ static int  deb_sr_river_show(VideoState *cur_stream)
 	    bgcolor = SDL_MapRGB(screen->format, 0x00, 0x00, 0x00);
 
 	    fill_rectangle(screen,0 ,0 , cur_stream->width , cur_stream->height -deb_ch_h*2-deb_ch_d , bgcolor,0); 
+	    deb_disp_dir_valid=0;
 
 	    // some at front , some at back , last showed at front
 	    for (i=0;i<=49;i++)
@@ -11304,6 +16718,7 @@ static int  deb_sr_river_f_cons_test(VideoState *cur_stream,int pp)
   bgcolor = SDL_MapRGB(screen->format, 0x00, 0x00, 0x00);
 
   fill_rectangle(screen,0 ,0 , cur_stream->width , cur_stream->height -deb_ch_h*2-deb_ch_d , bgcolor,0); 
+  deb_disp_dir_valid=0;
 
 
   for (i=0;i<101;i++)